@@ -0,0 +1,336 @@
+/*
+ *  Benchmark of radix sort against std::sort, std::stable_sort and their parallel versions.
+ *
+ *  Build (the parallel STL of libstdc++ uses TBB when it is installed):
+ *  g++ -std=c++17 -O2 -pthread benchmark.cpp -o benchmark -ltbb
+ *
+ *  Usage: benchmark [--max-size N] [--reps N] [--warmup N] [--format csv|json] [--filter TEXT]
+ *  - max-size: largest number of elements to sort, up to 1e9 (default 1e7).
+ *  - reps: timed runs per case (default 11). warmup: untimed runs per case (default 2).
+ *  - filter: run only the cases whose name (type/distribution/algorithm) contains TEXT.
+ *
+ *  Each case sorts a fresh copy of the same input on every run, and reports the median,
+ *  10th and 90th percentiles and minimum of the run times, and the median throughput.
+*/
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstring>
+#include <cmath>
+
+#if __has_include(<execution>)
+#include <execution>
+#endif
+
+using namespace std;
+
+#include "radix_sort_api.h"
+#include "some_class.h"
+
+struct BenchOptions
+{
+   size_t   max_size = 10000000;
+   size_t   reps = 11;
+   size_t   warmup = 2;
+   bool     json = false;
+   string   filter;
+};
+
+struct BenchResult
+{
+   string   type;
+   string   distribution;
+   string   algorithm;
+   size_t   size;
+   size_t   elem_bytes;
+   size_t   reps;
+   double   median;
+   double   p10;
+   double   p90;
+   double   min;
+   bool     sorted_ok;
+};
+
+enum class Distribution { uniform, sorted, reversed, few_unique, zipf, narrow_range };
+
+static const char *DistributionName(Distribution d)
+{
+   switch (d) {
+       case Distribution::uniform:      return "uniform";
+       case Distribution::sorted:       return "sorted";
+       case Distribution::reversed:     return "reversed";
+       case Distribution::few_unique:   return "few_unique";
+       case Distribution::zipf:         return "zipf";
+       case Distribution::narrow_range: return "narrow_range";
+   }
+   return "";
+}
+
+// draws ranks 0..num_ranks-1, rank r with probability proportional to 1 / (r + 1)
+class ZipfGenerator
+{
+public:
+   explicit ZipfGenerator(size_t num_ranks) : m_cdf(num_ranks)
+   {
+       double sum = 0;
+       for (size_t r = 0; r < num_ranks; ++r) {
+           sum += 1.0 / (double)(r + 1);
+           m_cdf[r] = sum;
+       }
+       for (double &c : m_cdf) {
+           c /= sum;
+       }
+   }
+
+   template <class RNG>
+   size_t operator()(RNG &rng)
+   {
+       const double u = uniform_real_distribution<double>(0.0, 1.0)(rng);
+       return std::min<size_t>(lower_bound(m_cdf.begin(), m_cdf.end(), u) - m_cdf.begin(), m_cdf.size() - 1);
+   }
+
+private:
+   vector<double> m_cdf;
+};
+
+// keys for the elements, as unsigned 64 bit values, spread over the whole range of a type of key_bits bits.
+static vector<uint64_t> GenerateKeys(Distribution d, size_t sz, size_t key_bits)
+{
+   mt19937_64 rng(12345);
+   const uint64_t key_max = (key_bits >= 64) ? UINT64_MAX : ((uint64_t)1 << key_bits) - 1;
+   vector<uint64_t> keys(sz);
+
+   switch (d) {
+       case Distribution::uniform:
+       case Distribution::sorted:
+       case Distribution::reversed: {
+           uniform_int_distribution<uint64_t> dist(0, key_max);
+           for (auto &k : keys) k = dist(rng);
+           if (Distribution::sorted == d) sort(keys.begin(), keys.end());
+           if (Distribution::reversed == d) sort(keys.begin(), keys.end(), greater<uint64_t>());
+           break;
+       }
+       case Distribution::few_unique: {
+           uint64_t values[16];
+           uniform_int_distribution<uint64_t> dist(0, key_max);
+           for (auto &v : values) v = dist(rng);
+           for (auto &k : keys) k = values[rng() % 16];
+           break;
+       }
+       case Distribution::zipf: {
+           // frequent ranks are scattered over the key range, not all at its bottom
+           ZipfGenerator zipf(1 << 16);
+           const uint64_t step = std::max<uint64_t>(key_max >> 16, 1);
+           for (auto &k : keys) k = (zipf(rng) * 40503 % (1 << 16)) * step & key_max;
+           break;
+       }
+       case Distribution::narrow_range: {
+           // a range of 1000 values in the middle of the key range
+           const uint64_t base = key_max / 2;
+           const uint64_t width = std::min<uint64_t>(1000, key_max - base);
+           for (auto &k : keys) k = base + rng() % (width + 1);
+           break;
+       }
+   }
+
+   return keys;
+}
+
+template <class T>
+static void KeysToElements(const vector<uint64_t> &keys, T *arr)
+{
+   for (size_t i = 0; i < keys.size(); ++i) {
+       if constexpr (is_same<T, SomeClass>::value) {
+           arr[i] = SomeClass(keys[i]);
+       }
+       else {
+           // map the unsigned key range onto T, keeping the order for signed types
+           using UT = make_unsigned_t<T>;
+           arr[i] = (T)(UT)((UT)keys[i] + (UT)numeric_limits<T>::min());
+       }
+   }
+}
+
+static double Percentile(const vector<double> &sorted_times, double pct)
+{
+   const double pos = pct * (double)(sorted_times.size() - 1);
+   const size_t lo = (size_t)floor(pos);
+   const size_t hi = (size_t)ceil(pos);
+   return sorted_times[lo] + (sorted_times[hi] - sorted_times[lo]) * (pos - (double)lo);
+}
+
+template <class T, class SORT>
+static BenchResult RunCase(
+       const BenchOptions &opts,
+       const char *type_name,
+       Distribution d,
+       const char *algorithm,
+       const vector<T> &input,
+       const SORT &sort_call)
+{
+   const size_t sz = input.size();
+   vector<T> work(sz);
+   vector<double> times;
+   bool sorted_ok = true;
+
+   for (size_t run = 0; run < opts.warmup + opts.reps; ++run) {
+       for (size_t i = 0; i < sz; ++i) {
+           work[i] = input[i];
+       }
+
+       const auto start = chrono::steady_clock::now();
+       sort_call(work.data(), sz);
+       const auto end = chrono::steady_clock::now();
+
+       if (run >= opts.warmup) {
+           times.push_back(chrono::duration<double>(end - start).count());
+       }
+       if (0 == run) {
+           sorted_ok = is_sorted(work.begin(), work.end());
+       }
+   }
+
+   sort(times.begin(), times.end());
+   return BenchResult{type_name, DistributionName(d), algorithm, sz, sizeof(T), times.size(),
+                      Percentile(times, 0.5), Percentile(times, 0.1), Percentile(times, 0.9), times[0], sorted_ok};
+}
+
+static void PrintHeader(const BenchOptions &opts)
+{
+   if (opts.json) {
+       cout << "[\n";
+   }
+   else {
+       cout << "type,distribution,algorithm,size,reps,median_sec,p10_sec,p90_sec,min_sec,"
+               "elements_per_sec,bytes_per_sec,sorted_ok\n";
+   }
+}
+
+static void PrintResult(const BenchOptions &opts, const BenchResult &r, bool first)
+{
+   const double elems_per_sec = (double)r.size / r.median;
+   const double bytes_per_sec = elems_per_sec * (double)r.elem_bytes;
+
+   if (opts.json) {
+       cout << (first ? "" : ",\n")
+            << "  {\"type\": \"" << r.type << "\", \"distribution\": \"" << r.distribution
+            << "\", \"algorithm\": \"" << r.algorithm << "\", \"size\": " << r.size
+            << ", \"reps\": " << r.reps << ", \"median_sec\": " << r.median
+            << ", \"p10_sec\": " << r.p10 << ", \"p90_sec\": " << r.p90 << ", \"min_sec\": " << r.min
+            << ", \"elements_per_sec\": " << elems_per_sec << ", \"bytes_per_sec\": " << bytes_per_sec
+            << ", \"sorted_ok\": " << (r.sorted_ok ? "true" : "false") << "}";
+   }
+   else {
+       cout << r.type << "," << r.distribution << "," << r.algorithm << "," << r.size << "," << r.reps << ","
+            << r.median << "," << r.p10 << "," << r.p90 << "," << r.min << ","
+            << elems_per_sec << "," << bytes_per_sec << "," << (r.sorted_ok ? 1 : 0) << "\n";
+   }
+   cout.flush();
+}
+
+static void PrintFooter(const BenchOptions &opts)
+{
+   if (opts.json) {
+       cout << "\n]\n";
+   }
+}
+
+template <class T>
+static void BenchType(const BenchOptions &opts, const char *type_name, size_t key_bits, bool &first)
+{
+   const Distribution distributions[] = {
+       Distribution::uniform, Distribution::sorted, Distribution::reversed,
+       Distribution::few_unique, Distribution::zipf, Distribution::narrow_range};
+
+   const size_t sizes[] = {16, 256, 4096, 65536, 1 << 20, 1 << 24, 1 << 28, 1000000000};
+
+   for (size_t sz : sizes) {
+       if (sz > opts.max_size) break;
+
+       for (Distribution d : distributions) {
+           vector<T> input(sz);
+           KeysToElements(GenerateKeys(d, sz, key_bits), input.data());
+
+           const auto run = [&](const char *algorithm, const auto &sort_call) {
+               const string name = string(type_name) + "/" + DistributionName(d) + "/" + algorithm;
+               if (!opts.filter.empty() && (string::npos == name.find(opts.filter))) return;
+
+               PrintResult(opts, RunCase(opts, type_name, d, algorithm, input, sort_call), first);
+               first = false;
+           };
+
+           if constexpr (is_same<T, SomeClass>::value) {
+               run("radix", [](T *arr, size_t n) { RadixSort(arr, n, SomeClass::getKey); });
+           }
+           else {
+               run("radix", [](T *arr, size_t n) { RadixSort(arr, n); });
+           }
+           run("std_sort", [](T *arr, size_t n) { sort(arr, arr + n); });
+           run("std_stable_sort", [](T *arr, size_t n) { stable_sort(arr, arr + n); });
+#if defined(__cpp_lib_parallel_algorithm)
+           run("std_sort_par", [](T *arr, size_t n) { sort(execution::par, arr, arr + n); });
+           run("std_stable_sort_par", [](T *arr, size_t n) { stable_sort(execution::par, arr, arr + n); });
+#endif
+       }
+   }
+}
+
+static bool ParseArgs(int argc, char **argv, BenchOptions &opts)
+{
+   for (int i = 1; i < argc; ++i) {
+       const bool has_value = (i + 1 < argc);
+       if (!strcmp(argv[i], "--max-size") && has_value) {
+           opts.max_size = (size_t)strtod(argv[++i], nullptr);
+       }
+       else if (!strcmp(argv[i], "--reps") && has_value) {
+           opts.reps = std::max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+       }
+       else if (!strcmp(argv[i], "--warmup") && has_value) {
+           opts.warmup = strtoul(argv[++i], nullptr, 10);
+       }
+       else if (!strcmp(argv[i], "--format") && has_value) {
+           opts.json = !strcmp(argv[++i], "json");
+       }
+       else if (!strcmp(argv[i], "--filter") && has_value) {
+           opts.filter = argv[++i];
+       }
+       else {
+           cerr << "Usage: " << argv[0]
+                << " [--max-size N] [--reps N] [--warmup N] [--format csv|json] [--filter TEXT]\n";
+           return false;
+       }
+   }
+
+   opts.max_size = std::min<size_t>(opts.max_size, 1000000000);
+   return true;
+}
+
+int main(int argc, char **argv)
+{
+   BenchOptions opts;
+   if (!ParseArgs(argc, argv, opts)) {
+       return 1;
+   }
+
+   srand(12345);
+
+   bool first = true;
+   PrintHeader(opts);
+   BenchType<int8_t>(opts, "int8", 8, first);
+   BenchType<uint8_t>(opts, "uint8", 8, first);
+   BenchType<int16_t>(opts, "int16", 16, first);
+   BenchType<uint16_t>(opts, "uint16", 16, first);
+   BenchType<int32_t>(opts, "int32", 32, first);
+   BenchType<uint32_t>(opts, "uint32", 32, first);
+   BenchType<int64_t>(opts, "int64", 64, first);
+   BenchType<uint64_t>(opts, "uint64", 64, first);
+   BenchType<SomeClass>(opts, "SomeClass", 64, first);
+   PrintFooter(opts);
+
+   return 0;
+}
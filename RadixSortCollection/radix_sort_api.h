@@ -79,11 +79,87 @@ int RadixSort(
     }
 }
 
+/* Description: Sort an array of any type T, that can be represented as an unsigned integral type, as RadixSort does,
+ * but rearrange the array by gathering the elements in their sorted order into scratch memory and moving them back,
+ * by up to num_threads threads. Meant for large arrays of large elements, whose rearrangement by RadixSort
+ * (a single thread chasing one cycle of swaps at a time) takes most of the time.
+ * With a single thread (or too few elements for more), the array is rearranged as RadixSort does.
+ * The function refers to the unsigned integral type as U.
+ *
+ * Parameters:
+ * - arr, num_elements, T_to_unsigned, usable_mem1, usable_mem2: As in RadixSort for an array of type T.
+ * - num_threads: Maximum number of threads to rearrange with, the calling thread being one of them.
+ *   Fewer are used when there are not enough elements to keep them busy.
+ * - usable_scratch: Supply if you don't want radix to allocate the scratch memory dynamically.
+ *   If supplied, must be a consecutive memory chunk of at least num_elements * sizeof(T), aligned for T.
+ *   Not needed when T is not larger than 2 * sizeof(size_t), since the free part of usable_mem1 / usable_mem2 is used.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure.
+ *
+ * Memory complexity: As RadixSort, and num_elements * sizeof(T) for the scratch, unless supplied or not needed
+ * (or the array is rearranged as RadixSort does).
+*/
+template <class T, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+int RadixSortGather(
+        T *arr,
+        size_t num_elements,
+        U(T_to_unsigned)(const T&),
+        size_t num_threads = 1,
+        void *usable_mem1 = nullptr,
+        void *usable_mem2 = nullptr,
+        void *usable_scratch = nullptr) noexcept
+{
+    try {
+        RadixConsecutiveGather(
+            arr, num_elements, T_to_unsigned, num_threads, usable_mem1, usable_mem2, usable_scratch);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Reorder an array by a permutation, such as the sorted indexes from RadixSortIndexesOnly:
+ * the element at arr[indexes[i]] is moved to arr[i]. The elements are gathered into scratch memory, and moved back,
+ * by up to num_threads threads.
+ *
+ * Parameters:
+ * - arr: The array to reorder.
+ * - num_elements: Number of elements in arr, and in indexes.
+ * - indexes: A permutation of the indexes of arr, of any unsigned integral type IDX.
+ * - num_threads: Maximum number of threads, the calling thread being one of them.
+ *   Fewer are used when there are not enough elements to keep them busy.
+ * - usable_memory: Supply if you don't want radix to allocate memory dynamically.
+ *   If supplied, must be a consecutive memory chunk of at least num_elements * sizeof(T), aligned for T.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure.
+ *
+ * Memory complexity: Unless usable_memory is provided, dynamically allocates num_elements * sizeof(T).
+*/
+template <class T, typename IDX, typename = std::enable_if_t<std::is_unsigned<IDX>::value>>
+int RadixApplyPermutation(
+        T *arr,
+        size_t num_elements,
+        const IDX *indexes,
+        size_t num_threads = 1,
+        void *usable_memory = nullptr) noexcept
+{
+    try {
+        auto scratch = GetRawMem<T>(num_elements, usable_memory);
+        RadixGather(arr, num_elements, [indexes](size_t i) { return (size_t)indexes[i]; }, scratch.get(), num_threads);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
 /* Description: Sort an array of any type T, that can be represented as an unsigned integral type, BUT without actually changing
  * the original array. Instead, fill an output array with the indexes of the elements from the original array, sorted.
  * Useful when needing different sort views of a single array at the same time.
  * Radix sorts an unsigned integral values that correspond to the elements, and then places the indexes in the output array accordingly.
- * The function refers to the unsigned integral type as U.
+ * The indexes are written directly by the last round of the sort, when possible.
+ * The function refers to the unsigned integral type as U, and to the type of the indexes as IDX.
  *
  * Parameters:
  * - arr: Read-only array to "sort".
@@ -91,39 +167,458 @@ int RadixSort(
  * - T_to_unsigned: A function that returns an unsigned integral representation of an element.
  *   If the return type of the function is not unsigned, compilation fails.
  * - out: Where the indexes of the elements, sorted, will be placed.
- *   Must be of at least the size: num_elements * sizeof(size_t)
+ *   Must be of at least the size: num_elements * sizeof(IDX)
+ *   IDX is any unsigned integral type, for example uint32_t for half the memory of size_t (up to 2^32 elements).
  * - usable_mem1 and usable_mem2: Supply if you don't want radix to allocate memory dynamically.
  *   Each of the two usable memories, if supplied, must be a consecutive memory chunk, at least of the size:
  *   num_elements * (2 * sizeof(size_t))
  *
- * Return: 0 for success, 1 in case of memory allocation failure.
+ * Return: 0 for success, 1 in case of memory allocation failure, 2 if num_elements is too large for IDX indexes.
  *
  * Memory complexity: For each of usable_mem1 and usable_mem2 which is not supplied, the sort dynamically allocates
  * a consecutive array of the size: num_elements * (2 * sizeof(size_t)).
 */
-template <class T, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+template <class T, typename U, typename IDX, typename = std::enable_if_t<std::is_unsigned<U>::value && std::is_unsigned<IDX>::value>>
 int RadixSortIndexesOnly(
+        const T *arr,
+        size_t num_elements,
+        U(*T_to_unsigned)(const T&),
+        IDX *out,
+        void *usable_mem1 = nullptr,
+        void *usable_mem2 = nullptr) noexcept
+{
+    if (num_elements && ((num_elements - 1) > std::numeric_limits<IDX>::max())) return 2;
+
+    try {
+        RadixIndexesImpl(arr, num_elements, T_to_unsigned, out, false, usable_mem1, usable_mem2);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Like RadixSortIndexesOnly, but fill the output array with the ranks of the elements instead: out[i] is the
+ * position of arr[i] in the sorted order. This is the inverse of the permutation that RadixSortIndexesOnly outputs.
+ * The ranks are written directly by the last round of the sort, when possible, rather than by inverting the indexes.
+ *
+ * Parameters: As in RadixSortIndexesOnly, with out being where the ranks will be placed.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure, 2 if num_elements is too large for IDX ranks.
+ *
+ * Memory complexity: As in RadixSortIndexesOnly.
+*/
+template <class T, typename U, typename IDX, typename = std::enable_if_t<std::is_unsigned<U>::value && std::is_unsigned<IDX>::value>>
+int RadixSortRanksOnly(
+        const T *arr,
+        size_t num_elements,
+        U(*T_to_unsigned)(const T&),
+        IDX *out,
+        void *usable_mem1 = nullptr,
+        void *usable_mem2 = nullptr) noexcept
+{
+    if (num_elements && ((num_elements - 1) > std::numeric_limits<IDX>::max())) return 2;
+
+    try {
+        RadixIndexesImpl(arr, num_elements, T_to_unsigned, out, true, usable_mem1, usable_mem2);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Get a sorted view of an array, like RadixSortIndexesOnly, together with its groups of elements that have
+ * equal unsigned integral representations: for each group, where it begins in out, its size and its representation.
+ * The groups are found while the sorted indexes are written to out, with no separate pass over the result.
+ *
+ * Parameters:
+ * - arr, num_elements, T_to_unsigned, out, usable_mem1 and usable_mem2: As in RadixSortIndexesOnly.
+ * - group_begins: Where the index in out of the first element of each group will be placed.
+ * - group_sizes: Where the number of elements of each group will be placed.
+ * - group_keys: Where the unsigned integral representation of each group will be placed.
+ *   Each of group_begins, group_sizes and group_keys may be nullptr, if not needed. Otherwise, must be large
+ *   enough for num_elements groups (when all representations differ), in elements of their type.
+ * - num_groups: Set to the number of groups.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure.
+ *
+ * Memory complexity: As in RadixSortIndexesOnly.
+*/
+template <class T, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+int RadixGroupBy(
         const T *arr,
         size_t num_elements,
         U(*T_to_unsigned)(const T&),
         size_t *out,
+        size_t *group_begins,
+        size_t *group_sizes,
+        U *group_keys,
+        size_t &num_groups,
+        void *usable_mem1 = nullptr,
+        void *usable_mem2 = nullptr) noexcept
+{
+    num_groups = 0;
+
+    try {
+        RadixConsecutive(
+            arr,
+            num_elements,
+            T_to_unsigned,
+            [&](RadixEntry<size_t> *sorted, RadixEntry<size_t> *) {
+                num_groups = RadixGroupOutput(sorted, num_elements, out, group_begins, group_sizes, group_keys);
+            },
+            usable_mem1,
+            usable_mem2);
+
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Sort an array of any integral type, and keep only one element of each value.
+ * The distinct values are placed, sorted, at the beginning of arr. The rest of arr is left with unspecified values.
+ * Duplicates are dropped while the sorted result is written to arr, with no separate pass over it.
+ *
+ * Parameters:
+ * - arr, num_elements, usable_memory: As in RadixSort for an array of an integral type.
+ * - num_unique: Set to the number of distinct values.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure.
+ *
+ * Memory complexity: As in RadixSort for an array of an integral type.
+*/
+template<class T, typename = std::enable_if_t<std::is_integral<T>::value>>
+int RadixUnique(T *arr, size_t num_elements, size_t &num_unique, void *usable_memory = nullptr) noexcept
+{
+    num_unique = 0;
+
+    try {
+        num_unique = RadixIntegral(arr, num_elements, (T*)usable_memory, true);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Sort each of many segments of an array of any integral type on its own, in one call.
+ * Useful for many small independent arrays, kept one after the other in a single buffer: the memory is allocated once
+ * for all of them, segments of up to 64 elements are sorted by std::sort (for which the setup of the counting rounds
+ * costs more than the sort), and the segments are split between threads.
+ *
+ * Parameters:
+ * - arr: The array that holds the segments.
+ * - segment_begins: num_segments + 1 indexes in arr: segment s is [segment_begins[s], segment_begins[s + 1]).
+ *   The elements of arr outside of the segments are left untouched.
+ * - num_segments: Number of segments.
+ * - num_threads: Maximum number of threads to sort with, the calling thread being one of them.
+ *   Fewer are used when there are not enough elements to keep them busy.
+ * - usable_memory: Supply if you don't want radix to allocate memory dynamically.
+ *   If supplied, must be a consecutive memory chunk, of at least num_threads times the size of the largest segment.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure, 2 if segment_begins is decreasing.
+ *
+ * Memory complexity: Unless usable_memory is provided, the sort dynamically allocates an array of up to num_threads
+ * times the size of the largest segment, which is shared by all the segments.
+*/
+template<class T, typename = std::enable_if_t<std::is_integral<T>::value>>
+int RadixSortSegments(
+        T *arr,
+        const size_t *segment_begins,
+        size_t num_segments,
+        size_t num_threads = 1,
+        void *usable_memory = nullptr) noexcept
+{
+    size_t max_segment_sz = 0;
+    if (!RadixSegmentsValid(segment_begins, num_segments, max_segment_sz)) return 2;
+
+    try {
+        RadixSegmentsIntegral(arr, segment_begins, num_segments, max_segment_sz, num_threads, usable_memory);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Sort each of many segments of an array of any type T, that can be represented as an unsigned integral
+ * type, on its own, in one call. As RadixSortSegments for integral types, with each segment sorted as RadixSort does,
+ * except for segments of up to 32 elements: their keys are extracted once, and sorted by std::sort along with their
+ * positions (which keeps equal keys in order), and the segment is then rearranged accordingly.
+ * The function refers to the unsigned integral type as U.
+ *
+ * Parameters:
+ * - arr, segment_begins, num_segments, num_threads: As in RadixSortSegments for an array of an integral type.
+ * - T_to_unsigned: A function that returns an unsigned integral representation of an element.
+ *   If the return type of the function is not unsigned, compilation fails.
+ * - usable_mem1 and usable_mem2: Supply if you don't want radix to allocate memory dynamically.
+ *   Each of the two usable memories, if supplied, must be a consecutive memory chunk, at least of the size:
+ *   num_threads * (size of the largest segment) * (2 * sizeof(size_t))
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure, 2 if segment_begins is decreasing.
+ *
+ * Memory complexity: For each of usable_mem1 and usable_mem2 which is not supplied, the sort dynamically allocates
+ * a consecutive array of up to the size: num_threads * (size of the largest segment) * (2 * sizeof(size_t)).
+*/
+template <class T, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+int RadixSortSegments(
+        T *arr,
+        const size_t *segment_begins,
+        size_t num_segments,
+        U(T_to_unsigned)(const T&),
+        size_t num_threads = 1,
         void *usable_mem1 = nullptr,
         void *usable_mem2 = nullptr) noexcept
 {
+    size_t max_segment_sz = 0;
+    if (!RadixSegmentsValid(segment_begins, num_segments, max_segment_sz)) return 2;
+
     try {
+        RadixSegmentsUserDefined(
+            arr, segment_begins, num_segments, max_segment_sz, T_to_unsigned, num_threads, usable_mem1, usable_mem2);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Sort an array of any integral type asynchronously, on a caller-supplied executor (e.g. a thread pool),
+ * for pipelines that sort one batch while the next one is being produced. Several sorts submitted to a pool of several
+ * threads run concurrently, each on one thread: the key extraction and scan of a batch overlap the rounds of another.
+ *
+ * Parameters:
+ * - executor: Called once, with the sort task as a std::function<void()>, which it must run once, on any thread.
+ *   For example: [&pool](std::function<void()> task) { pool.Post(std::move(task)); }
+ * - arr, num_elements, usable_memory: As in RadixSort for an array of an integral type.
+ *   They must stay valid until the future is ready, and must not be used by the caller meanwhile.
+ * - cancel_token: Optional. Once cancelled, the sort stops before its next round (or does not start at all),
+ *   leaving arr with its elements in an unspecified order.
+ *
+ * Return: A future of the result of the sort: 0 for success, 1 in case of memory allocation failure, 3 if cancelled.
+ * The future is invalid (valid() is false) if the task could not be created, or the executor threw.
+ *
+ * Memory complexity: As in RadixSort for an array of an integral type, allocated by the thread that runs the task.
+*/
+template <class EXECUTOR, class T, typename = std::enable_if_t<std::is_integral<T>::value>>
+std::future<int> RadixSortAsync(
+        EXECUTOR &&executor,
+        T *arr,
+        size_t num_elements,
+        const RadixCancelToken *cancel_token = nullptr,
+        void *usable_memory = nullptr) noexcept
+{
+    return RadixAsyncImpl(executor, cancel_token, [=]() {
+        RadixIntegral(arr, num_elements, (T*)usable_memory);
+    });
+}
+
+/* Description: Sort an array of any type T, that can be represented as an unsigned integral type, asynchronously,
+ * as RadixSortAsync for an array of an integral type. The function refers to the unsigned integral type as U.
+ *
+ * Parameters:
+ * - executor, cancel_token: As in RadixSortAsync for an array of an integral type.
+ *   The array is rearranged only after the last round, so a cancelled sort leaves it unchanged.
+ * - arr, num_elements, T_to_unsigned, usable_mem1, usable_mem2: As in RadixSort for an array of type T.
+ *   They must stay valid until the future is ready, and must not be used by the caller meanwhile.
+ *
+ * Return: A future of the result of the sort: 0 for success, 1 in case of memory allocation failure, 3 if cancelled.
+ * The future is invalid (valid() is false) if the task could not be created, or the executor threw.
+ *
+ * Memory complexity: As in RadixSort for an array of type T, allocated by the thread that runs the task.
+*/
+template <class EXECUTOR, class T, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+std::future<int> RadixSortAsync(
+        EXECUTOR &&executor,
+        T *arr,
+        size_t num_elements,
+        U(*T_to_unsigned)(const T&),
+        const RadixCancelToken *cancel_token = nullptr,
+        void *usable_mem1 = nullptr,
+        void *usable_mem2 = nullptr) noexcept
+{
+    return RadixAsyncImpl(executor, cancel_token, [=]() {
         RadixConsecutive(
             arr,
             num_elements,
             T_to_unsigned,
-            [=](RadixEntry<size_t> *sorted, RadixEntry<size_t> *) {
-                size_t *p_out = out;
-                for (size_t i = 0; i < num_elements; ++sorted, ++p_out, ++i) {
-                    *p_out = sorted->m_first;
-                }
+            [=](RadixEntry<size_t> *sorted, RadixEntry<size_t> *helper_memory){
+                RearrangeArr<T>(arr, num_elements, sorted, helper_memory);
             },
             usable_mem1,
             usable_mem2);
+    });
+}
 
+/* Description: Sort an array of any integral type, with no more helper memory than mem_budget bytes.
+ * Instead of failing when memory is short, the sort picks the fastest strategy that fits in the budget:
+ * - RadixStrategy::lsd: The regular sort (as RadixSort), if its helper memory of the size of arr fits.
+ * - RadixStrategy::in_place_msd: Otherwise, rounds from the highest digit down, that permute arr in place.
+ * The in-place strategy is also used if the helper memory that fits cannot be allocated.
+ *
+ * Parameters:
+ * - arr, num_elements: As in RadixSort for an array of an integral type.
+ * - mem_budget: The maximum of helper memory to allocate, in bytes.
+ * - report: Optional. Set to the strategy that ran, and the helper memory it allocated.
+ *
+ * Return: 0 for success. Lack of memory does not fail the sort.
+ *
+ * Memory complexity: Up to mem_budget bytes, which is all that is allocated dynamically: a range of keys that would be
+ * counted in a single round with more than 2^11 counters, is sorted in rounds of narrower digits instead, so that the
+ * counters are on the stack. Up to about 40KB of stack.
+*/
+template<class T, typename = std::enable_if_t<std::is_integral<T>::value>>
+int RadixSortWithBudget(T *arr, size_t num_elements, size_t mem_budget, RadixBudgetReport *report = nullptr) noexcept
+{
+    try {
+        const RadixBudgetReport budget_report = RadixIntegralBudget(arr, num_elements, mem_budget);
+        if (report) {
+            *report = budget_report;
+        }
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Sort an array of any type T, that can be represented as an unsigned integral type, with no more helper
+ * memory than mem_budget bytes. Instead of failing when memory is short, the sort picks the fastest strategy that fits
+ * in the budget, all of them stable:
+ * - RadixStrategy::lsd: The regular sort (as RadixSort), if its two usable memories fit.
+ * - RadixStrategy::chunked_merge: Otherwise, sort chunks of the largest size whose usable memories fit, as RadixSort
+ *   does, and then merge them in place, with the same memory as the buffer of the merges.
+ * - RadixStrategy::in_place_merge: As chunked_merge, for a budget too small for even the smallest chunks, with small
+ *   chunks sorted with memory on the stack, and merges without buffer.
+ * The in-place strategy is also used if the helper memory that fits cannot be allocated.
+ * The function refers to the unsigned integral type as U.
+ *
+ * Parameters:
+ * - arr, num_elements, T_to_unsigned: As in RadixSort for an array of type T.
+ * - mem_budget: The maximum of helper memory to allocate, in bytes.
+ * - report: Optional. Set to the strategy that ran, and the helper memory it allocated.
+ *
+ * Return: 0 for success. Lack of memory does not fail the sort.
+ *
+ * Memory complexity: Up to mem_budget bytes, which is all that is allocated dynamically, as in RadixSortWithBudget for
+ * an array of an integral type. Up to about 40KB of stack.
+*/
+template <class T, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+int RadixSortWithBudget(
+        T *arr,
+        size_t num_elements,
+        U(T_to_unsigned)(const T&),
+        size_t mem_budget,
+        RadixBudgetReport *report = nullptr) noexcept
+{
+    try {
+        const RadixBudgetReport budget_report = RadixUserDefinedBudget(arr, num_elements, T_to_unsigned, mem_budget);
+        if (report) {
+            *report = budget_report;
+        }
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Partition an array of any unsigned integral type (e.g. hashes) into buckets by a digit of the values:
+ * the digit_bits bits above the lowest shift_bits bits. A single counting round of radix sort (MSD pass), for radix
+ * hash joins and for distributing values between workers.
+ * The partition is stable: within each bucket, the values keep their order in the input.
+ *
+ * Parameters:
+ * - in: The values to partition.
+ * - num_elements: Number of values in in.
+ * - shift_bits, digit_bits: The digit of a value is (value >> shift_bits) & ((1 << digit_bits) - 1).
+ *   digit_bits must be 1 to 16 (2 to 65536 buckets), and shift_bits must be below the number of bits of T.
+ * - out: Where the partitioned values will be placed. Must be of at least num_elements values, and not overlap in.
+ * - bucket_begins: Set to where each bucket begins in out. Must be of at least (1 << digit_bits) + 1 elements,
+ *   the last one set to num_elements, so bucket b is [bucket_begins[b], bucket_begins[b + 1]).
+ * - num_threads: Maximum number of threads to partition with, the calling thread being one of them.
+ *   Fewer are used when there are not enough values to keep them busy.
+ * - write_combining: Collect the values of each bucket in a cache line aligned buffer, and write each line of out
+ *   that the bucket fills in one go, with streaming stores where SSE2 is available (so the lines of out are not read
+ *   into the cache first). The partial lines at the ends of each bucket are written as usual.
+ *   Applies only when sizeof(T) divides the cache line (64 bytes) and out is aligned to sizeof(T), otherwise
+ *   ignored. Costs a copy of each value, and pays off when out is much larger than the cache, e.g. about twice as
+ *   fast for 16M uint64_t with 8 to 12 bits digits, but by less as the digit grows, since the buffers then no longer
+ *   fit in the cache either. Measure on the target machine.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure, 2 if digit_bits or shift_bits is out of range.
+ *
+ * Memory complexity: num_threads * (1 << digit_bits) * sizeof(size_t) for the counters, and with write_combining,
+ * per thread another ((1 << digit_bits) + 1) cache lines for the buffers and (1 << digit_bits) * sizeof(size_t).
+*/
+template<class T, typename = std::enable_if_t<std::is_unsigned<T>::value>>
+int RadixPartition(
+        const T *in,
+        size_t num_elements,
+        size_t shift_bits,
+        size_t digit_bits,
+        T *out,
+        size_t *bucket_begins,
+        size_t num_threads = 1,
+        bool write_combining = false) noexcept
+{
+    if ((0 == digit_bits) || (digit_bits > RadixPartitionMaxBits) || (shift_bits >= sizeof(T) * CHAR_BIT)) return 2;
+
+    try {
+        const size_t mask = (size_t(1) << digit_bits) - 1;
+        RadixPartitionImpl(in, num_elements, mask + 1, [=](T val) { return (size_t)(val >> shift_bits) & mask; },
+                           out, bucket_begins, num_threads, write_combining);
+        return 0;
+    }
+    catch (...) {
+        return 1;
+    }
+}
+
+/* Description: Partition an array of any type T, that can be represented as an unsigned integral type, into buckets
+ * by a digit of the unsigned integral values of the elements, as RadixPartition for an array of an unsigned integral
+ * type. For example, tuples of a key and a payload, partitioned by the bits of a hash of the key.
+ * The elements are copied to out, and write_combining applies only when T is trivially copyable.
+ * The function refers to the unsigned integral type as U.
+ *
+ * Parameters:
+ * - in, num_elements, shift_bits, digit_bits, out, bucket_begins, num_threads, write_combining:
+ *   As in RadixPartition for an array of an unsigned integral type, with shift_bits below the number of bits of U.
+ * - T_to_unsigned: A function that returns an unsigned integral representation of an element.
+ *   If the return type of the function is not unsigned, compilation fails.
+ *
+ * Return: 0 for success, 1 in case of memory allocation failure, 2 if digit_bits or shift_bits is out of range.
+ *
+ * Memory complexity: As in RadixPartition for an array of an unsigned integral type.
+*/
+template <class T, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+int RadixPartition(
+        const T *in,
+        size_t num_elements,
+        U(T_to_unsigned)(const T&),
+        size_t shift_bits,
+        size_t digit_bits,
+        T *out,
+        size_t *bucket_begins,
+        size_t num_threads = 1,
+        bool write_combining = false) noexcept
+{
+    if ((0 == digit_bits) || (digit_bits > RadixPartitionMaxBits) || (shift_bits >= sizeof(U) * CHAR_BIT)) return 2;
+
+    try {
+        const size_t mask = (size_t(1) << digit_bits) - 1;
+        RadixPartitionImpl(
+            in,
+            num_elements,
+            mask + 1,
+            [=](const T &elem) { return (size_t)(T_to_unsigned(elem) >> shift_bits) & mask; },
+            out,
+            bucket_begins,
+            num_threads,
+            write_combining);
         return 0;
     }
     catch (...) {
@@ -166,4 +661,259 @@ int RadixSort(
     }
 }
 
+/* Description: Return a sorted copy of a std::array of any integral type.
+ * Can be evaluated at compile time, for example for a static lookup table:
+ * constexpr auto table = RadixSorted(std::array{...});
+ *
+ * Memory complexity: Uses a second std::array of the same size, on the stack (or in the compiler, at compile time).
+ * Note: At compile time, the compiler's constexpr limits apply. For example, g++ limits the number of operations
+ * of an evaluation (-fconstexpr-ops-limit), which by default allows sorting 10,000s of 4 byte values.
+ * Raise the limit for larger tables.
+*/
+template <class T, size_t N, typename = std::enable_if_t<std::is_integral<T>::value>>
+constexpr std::array<T, N> RadixSorted(std::array<T, N> arr) noexcept
+{
+    RadixIntegralConstexpr(arr);
+    return arr;
+}
+
+/* Description: Return a sorted copy of a std::array of any type T, that can be represented as an unsigned integral type.
+ * Elements with equal representations keep their original order.
+ * Can be evaluated at compile time when T_to_unsigned is a constexpr function, and T is a literal type.
+ *
+ * Parameters:
+ * - arr: The array to sort.
+ * - T_to_unsigned: A function that returns an unsigned integral representation of an element.
+ *   If the return type of the function is not unsigned, compilation fails.
+ *
+ * Memory complexity: Uses two arrays of N * (2 * sizeof(size_t)) on the stack, and requires T to be default
+ * constructible and copy assignable. Compile time limits are as above.
+*/
+template <class T, size_t N, typename U, typename = std::enable_if_t<std::is_unsigned<U>::value>>
+constexpr std::array<T, N> RadixSorted(const std::array<T, N> &arr, U(*T_to_unsigned)(const T&)) noexcept
+{
+    return RadixConsecutiveConstexpr(arr, T_to_unsigned);
+}
+
+/* Description: Collect per-phase stats of every sort that runs on the calling thread while the scope is alive.
+ * The stats are added to the given RadixStats (see its members in radix_sort_internal.h), so that several sorts
+ * can be summed up. Scopes can be nested, the innermost one collects.
+ * Phases: key extraction, histogram and scatter of each round, scan of integral arrays for sorted runs and min / max,
+ * merging of presorted runs, and rearrangement of the sorted array / list.
+ * Each phase counts its wall time, number of calls and elements passed over.
+ * Also counted: rounds scattered, rounds skipped (all elements had the same digit), bytes moved, bytes of
+ * helper memory the sort allocated dynamically, and sorts whose input was already sorted / reverse sorted.
+ *
+ * Stats are collected only when RADIX_SORT_STATS is defined before including this header.
+ * Otherwise the scope does nothing, and the sorts compile without any stats code.
+*/
+class RadixStatsScope
+{
+public:
+    explicit RadixStatsScope(RadixStats &stats) noexcept
+    {
+#ifdef RADIX_SORT_STATS
+        m_prev_stats = RadixCurStats();
+        RadixCurStats() = &stats;
+#else
+        (void)stats;
+#endif
+    }
+
+    ~RadixStatsScope()
+    {
+#ifdef RADIX_SORT_STATS
+        RadixCurStats() = m_prev_stats;
+#endif
+    }
+
+    RadixStatsScope(const RadixStatsScope&) = delete;
+    RadixStatsScope& operator=(const RadixStatsScope&) = delete;
+
+private:
+#ifdef RADIX_SORT_STATS
+    RadixStats *m_prev_stats;
+#endif
+};
+
+/* Description: Sort a stream of elements that arrives in chunks. Each pushed chunk is radix sorted into a run,
+ * and pulling merges the runs (k-way merge with a loser tree) into globally sorted output.
+ * Two flavours:
+ * - RadixStreamSorter<T>: T is an integral type, sorted by value.
+ * - RadixStreamSorter<T, U>: T is any type that can be represented as the unsigned integral type U,
+ *   sorted by T_to_unsigned. Elements with equal keys are pulled in the order they were pushed.
+ * T must be trivially copyable, since runs may be spilled to disk as raw bytes.
+ *
+ * Usage: Push() all the chunks, then Pull() until it outputs no more elements.
+ * Once Pull() was called, the sorter accepts no more chunks.
+ *
+ * Memory complexity: Sorted runs are held in memory until they exceed mem_budget bytes, and then all of them
+ * are spilled to a temporary file, which is deleted when the sorter is destroyed. While merging, each spilled
+ * run is read back in blocks that share the budget left by the runs in memory (at least 256 elements each).
+ * Sorting a chunk dynamically allocates the same helper memory as RadixSort does for an array of that size.
+*/
+template <class T, class U = void>
+class RadixStreamSorter
+{
+    static_assert(std::is_trivially_copyable<T>::value, "RadixStreamSorter requires a trivially copyable type");
+    static_assert(std::is_void<U>::value ? std::is_integral<T>::value : std::is_unsigned<U>::value,
+                  "RadixStreamSorter<T> requires an integral T, RadixStreamSorter<T, U> requires an unsigned U");
+
+public:
+    /* Parameters:
+     * - mem_budget: Bytes of sorted runs to hold in memory before spilling them to disk.
+    */
+    template <class V = U, typename = std::enable_if_t<std::is_void<V>::value>>
+    explicit RadixStreamSorter(size_t mem_budget) noexcept :
+        m_impl(nullptr, mem_budget)
+    {}
+
+    /* Parameters:
+     * - T_to_unsigned: A function that returns an unsigned integral representation of an element.
+     * - mem_budget: Bytes of sorted runs to hold in memory before spilling them to disk.
+    */
+    template <class V = U, typename = std::enable_if_t<!std::is_void<V>::value>>
+    RadixStreamSorter(V(*T_to_unsigned)(const T&), size_t mem_budget) noexcept :
+        m_impl(T_to_unsigned, mem_budget)
+    {}
+
+    /* Description: Sort a chunk of elements into a new run. The chunk is copied, and can be reused after the call.
+     *
+     * Return: 0 for success, 1 in case of memory allocation or spill file failure (the chunk is then not taken, and
+     * pushing it may be retried), 2 if Pull() was already called.
+    */
+    int Push(const T *chunk, size_t num_elements) noexcept
+    {
+        if (m_impl.IsMerging()) return 2;
+
+        try {
+            m_impl.Push(chunk, num_elements);
+            return 0;
+        }
+        catch (...) {
+            return 1;
+        }
+    }
+
+    /* Description: Output the next smallest elements of everything that was pushed.
+     *
+     * Parameters:
+     * - out: Where the elements will be placed. Must be of at least the size: max_out * sizeof(T)
+     * - max_out: Maximum number of elements to output.
+     * - num_out: Set to the number of elements placed in out. Less than max_out only when the stream is exhausted,
+     *   or when reading back a spilled run failed (in which case the next pull returns 1).
+     *
+     * Return: 0 for success, 1 in case of memory allocation or spill file failure (pulling may be retried).
+    */
+    int Pull(T *out, size_t max_out, size_t &num_out) noexcept
+    {
+        num_out = 0;
+
+        try {
+            num_out = m_impl.Pull(out, max_out);
+            return 0;
+        }
+        catch (...) {
+            return 1;
+        }
+    }
+
+private:
+    RadixStreamImpl<T, U> m_impl;
+};
+
+/* Description: Read the sorted order of an array lazily, for readers of only a prefix of it (pages, top-k, early exit).
+ * The first pull partitions the array into 256 buckets by the highest digit of the keys (relative to the min key), in
+ * a single pass. A bucket is then sorted (as RadixSort does) only when pulling reaches it, so pulling a first page of
+ * the sorted order costs about a pass over the array, and the sort of one bucket.
+ * Two flavours:
+ * - RadixSortedCursor<T>: T is an integral type. The array itself is sorted in place, bucket by bucket: once all of
+ *   it was pulled, it is sorted. Its elements must not be changed by the caller meanwhile.
+ * - RadixSortedCursor<T, U>: T is any type that can be represented as the unsigned integral type U. The array is left
+ *   unchanged, and must not be changed meanwhile. Elements with equal keys are pulled in their order in the array.
+ *
+ * Memory complexity:
+ * - RadixSortedCursor<T>: Helper memory of the size of the largest bucket, allocated dynamically on its first sort,
+ *   unless usable_memory is supplied (of at least the size of the array).
+ * - RadixSortedCursor<T, U>: For each of usable_mem1 and usable_mem2 which is not supplied, the first pull dynamically
+ *   allocates a consecutive array of the size: num_elements * (2 * sizeof(size_t)).
+*/
+template <class T, class U = void>
+class RadixSortedCursor
+{
+    static_assert(std::is_void<U>::value ? std::is_integral<T>::value : std::is_unsigned<U>::value,
+                  "RadixSortedCursor<T> requires an integral T, RadixSortedCursor<T, U> requires an unsigned U");
+
+public:
+    /* Parameters:
+     * - arr: The array to sort lazily, in place.
+     * - num_elements: Number of elements in arr.
+     * - usable_memory: Supply if you don't want radix to allocate memory dynamically.
+     *   If supplied, must be a consecutive memory chunk, at least the size of arr.
+    */
+    template <class V = U, typename = std::enable_if_t<std::is_void<V>::value>>
+    RadixSortedCursor(T *arr, size_t num_elements, void *usable_memory = nullptr) noexcept :
+        m_impl(arr, num_elements, nullptr, usable_memory, nullptr)
+    {}
+
+    /* Parameters:
+     * - arr: Read-only array to "sort" lazily.
+     * - num_elements: Number of elements in arr.
+     * - T_to_unsigned: A function that returns an unsigned integral representation of an element.
+     * - usable_mem1 and usable_mem2: As in RadixSort for an array of type T.
+    */
+    template <class V = U, typename = std::enable_if_t<!std::is_void<V>::value>>
+    RadixSortedCursor(
+            const T *arr,
+            size_t num_elements,
+            V(*T_to_unsigned)(const T&),
+            void *usable_mem1 = nullptr,
+            void *usable_mem2 = nullptr) noexcept :
+        m_impl(arr, num_elements, T_to_unsigned, usable_mem1, usable_mem2)
+    {}
+
+    /* Description: Output the next elements of the sorted order.
+     *
+     * Parameters:
+     * - out: Where the elements will be placed (copied). Must be of at least the size: max_out * sizeof(T)
+     * - max_out: Maximum number of elements to output.
+     * - num_out: Set to the number of elements placed in out. Less than max_out only when the array is exhausted,
+     *   or when sorting the next bucket failed (in which case the next pull returns 1).
+     *
+     * Return: 0 for success, 1 in case of memory allocation failure (pulling may be retried).
+    */
+    int Pull(T *out, size_t max_out, size_t &num_out) noexcept
+    {
+        num_out = 0;
+
+        try {
+            num_out = m_impl.Pull(out, max_out);
+            return 0;
+        }
+        catch (...) {
+            return 1;
+        }
+    }
+
+    /* Description: As Pull, but output the indexes in arr of the next elements of the sorted order.
+     * Available in RadixSortedCursor<T, U> only.
+    */
+    template <class V = U, typename = std::enable_if_t<!std::is_void<V>::value>>
+    int PullIndexes(size_t *out, size_t max_out, size_t &num_out) noexcept
+    {
+        num_out = 0;
+
+        try {
+            num_out = m_impl.PullIndexes(out, max_out);
+            return 0;
+        }
+        catch (...) {
+            return 1;
+        }
+    }
+
+private:
+    RadixCursorImpl<T, U> m_impl;
+};
+
 #endif // RADIX_SORT_COLLECTION_API_H
@@ -2,96 +2,777 @@
 #define RADIX_SORT_INTERNAL
 
 #include <list>
+#include <algorithm>
 #include <memory>
 #include <climits>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <array>
+#include <cstdio>
+#include <stdexcept>
+#include <type_traits>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <exception>
+#include <atomic>
+#include <future>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+struct RadixPhaseStats
+{
+    uint64_t    m_nanoseconds = 0;
+    // times the phase ran, and elements it went over, summed over all the runs.
+    size_t      m_calls = 0;
+    size_t      m_elements = 0;
+};
+
+struct RadixStats
+{
+    // reading the elements into radix entries (T_to_unsigned calls).
+    RadixPhaseStats m_key_extraction;
+    // counting the digits of a round, and scattering the elements by them.
+    RadixPhaseStats m_histogram;
+    RadixPhaseStats m_scatter;
+    // looking for sorted runs, min and max in an integral array (keyed sorts do it during key extraction).
+    RadixPhaseStats m_key_scan;
+    // merging the sorted runs of an input that has only a few of them, instead of the rounds.
+    RadixPhaseStats m_merge;
+    // reordering the original array / list by the sorted entries.
+    RadixPhaseStats m_rearrange;
+
+    size_t          m_rounds = 0;
+    // rounds without scatter, since all the elements had the same digit.
+    size_t          m_rounds_skipped = 0;
+    size_t          m_bytes_moved = 0;
+    size_t          m_scratch_bytes_allocated = 0;
+    // sorts that found their input already sorted, or reverse sorted.
+    size_t          m_presorted = 0;
+    size_t          m_reversed = 0;
+};
+
+#ifdef RADIX_SORT_STATS
+
+#include <chrono>
+
+// the stats that sorts running on this thread report to, if any.
+inline RadixStats *&RadixCurStats()
+{
+    thread_local RadixStats *stats = nullptr;
+    return stats;
+}
+
+class RadixPhaseTimer
+{
+public:
+    RadixPhaseTimer(RadixPhaseStats RadixStats::*phase, size_t elements) :
+        m_stats(RadixCurStats()),
+        m_phase(phase),
+        m_elements(elements),
+        m_start(m_stats ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+    {}
+
+    ~RadixPhaseTimer()
+    {
+        if (!m_stats) return;
+
+        RadixPhaseStats &phase = m_stats->*m_phase;
+        phase.m_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start).count();
+        ++phase.m_calls;
+        phase.m_elements += m_elements;
+    }
+
+private:
+    RadixStats                              *m_stats;
+    RadixPhaseStats RadixStats::*            m_phase;
+    size_t                                   m_elements;
+    std::chrono::steady_clock::time_point    m_start;
+};
+
+#define RADIX_STATS_PHASE(phase, elements) \
+    RadixPhaseTimer radix_phase_timer(&RadixStats::phase, (elements))
+#define RADIX_STATS_ADD(counter, value) \
+    do { if (RadixStats *radix_stats = RadixCurStats()) radix_stats->counter += (value); } while (0)
+
+#else
+
+#define RADIX_STATS_PHASE(phase, elements)
+#define RADIX_STATS_ADD(counter, value)
+
+#endif // RADIX_SORT_STATS
+
+// Cancels the sorts that check it, see RadixSortAsync. May be cancelled from any thread.
+class RadixCancelToken
+{
+public:
+    void Cancel() noexcept { m_cancelled.store(true, std::memory_order_relaxed); }
+    bool IsCancelled() const noexcept { return m_cancelled.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> m_cancelled{false};
+};
+
+// Thrown from a sort running on a thread whose cancel token was cancelled.
+struct RadixCancelled {};
+
+// the cancel token that sorts running on this thread check, if any.
+inline const RadixCancelToken *&RadixCurCancelToken()
+{
+    thread_local const RadixCancelToken *token = nullptr;
+    return token;
+}
+
+// Checked before each round, and before other passes over all the elements, which leave the elements complete
+// (though in an unspecified order) if they throw.
+inline void RadixCheckCancelled()
+{
+    const RadixCancelToken *token = RadixCurCancelToken();
+    if (token && token->IsCancelled()) throw RadixCancelled();
+}
 
 template <class T>
 auto GetMem(size_t sz, void *usable_mem = nullptr)
 {
     using mem_ptr = std::unique_ptr<T[], void(*)(T*)>;
 
-    return (nullptr == usable_mem) ?
-            mem_ptr(new T[sz], [](T* mem){delete [] mem;}) :
-            mem_ptr((T*)usable_mem, [](T*){});
+    if (nullptr == usable_mem) {
+        RADIX_STATS_ADD(m_scratch_bytes_allocated, sz * sizeof(T));
+        return mem_ptr(new T[sz], [](T* mem){delete [] mem;});
+    }
+    return mem_ptr((T*)usable_mem, [](T*){});
+}
+
+// Deletes the memory of GetRawMem, unless it was supplied by the user.
+template <class T>
+struct RadixRawMemDeleter
+{
+    size_t  m_sz;
+    bool    m_owned;
+
+    void operator()(T *mem) const
+    {
+        if (m_owned) std::allocator<T>().deallocate(mem, m_sz);
+    }
+};
+
+// As GetMem, for memory of sz elements that are not constructed, which does not require T to be default constructible.
+template <class T>
+auto GetRawMem(size_t sz, void *usable_mem = nullptr)
+{
+    using mem_ptr = std::unique_ptr<T, RadixRawMemDeleter<T>>;
+
+    if (nullptr == usable_mem) {
+        RADIX_STATS_ADD(m_scratch_bytes_allocated, sz * sizeof(T));
+        return mem_ptr(std::allocator<T>().allocate(sz), RadixRawMemDeleter<T>{sz, true});
+    }
+    return mem_ptr((T*)usable_mem, RadixRawMemDeleter<T>{sz, false});
+}
+
+// Tracks the non-decreasing runs, and the min and max, of a sequence of keys, fed one at a time.
+// Used for the presorted fast paths, and for sorting by the range of the keys, rather than by their type.
+// A sequence of few runs is sorted by merging them, in up to log2(max_runs) passes.
+template <class KEY>
+class RadixKeyScanner
+{
+public:
+    static constexpr size_t m_max_runs_limit = 16;
+
+    // strict_descent: whether a descending sequence must not have equal keys (for keeping stability).
+    RadixKeyScanner(size_t max_runs, bool strict_descent) :
+        m_max_runs(std::min(max_runs, m_max_runs_limit)),
+        m_strict_descent(strict_descent)
+    {}
+
+    void Start(const KEY &first_key)
+    {
+        m_min = m_max = first_key;
+    }
+
+    void Add(size_t idx, const KEY &key, const KEY &prev_key)
+    {
+        // a key smaller than the one before it can't be a new max, and vice versa.
+        if (key < prev_key) {
+            if (m_num_runs < m_max_runs) {
+                m_run_begins[m_num_runs] = idx;
+            }
+            m_num_runs += (m_num_runs <= m_max_runs);
+            if (key < m_min) m_min = key;
+        }
+        else {
+            if (m_strict_descent || (prev_key < key)) m_is_descending = false;
+            if (m_max < key) m_max = key;
+        }
+    }
+
+    // the key is known not to start a run that matters: only its min and max are tracked.
+    void AddMinMax(const KEY &key)
+    {
+        m_min = std::min(m_min, key);
+        m_max = std::max(m_max, key);
+    }
+
+    // true when none of the presorted fast paths can apply anymore, so Add() can be replaced by AddMinMax().
+    bool IsHopeless() const { return (m_num_runs > m_max_runs) && !m_is_descending; }
+    bool IsSorted() const { return 1 == m_num_runs; }
+    // a sequence of equal keys is sorted, not descending.
+    bool IsDescending() const { return m_is_descending && !IsSorted(); }
+    bool HasFewRuns() const { return m_num_runs <= m_max_runs; }
+    size_t NumRuns() const { return m_num_runs; }
+    size_t *RunBegins() { return m_run_begins; }
+    const KEY &Min() const { return m_min; }
+    const KEY &Max() const { return m_max; }
+
+private:
+    size_t  m_max_runs;
+    bool    m_strict_descent;
+    bool    m_is_descending = true;
+    size_t  m_num_runs = 1;
+    size_t  m_run_begins[m_max_runs_limit] = {0};
+    KEY     m_min = KEY();
+    KEY     m_max = KEY();
+};
+
+// Max number of runs for which merging them may be cheaper than radix sorting keys of key_sz bytes:
+// merging takes log2(runs) passes, compared to up to key_sz rounds, and a merge pass costs more than a round.
+constexpr size_t RadixMaxMergeRuns(size_t key_sz)
+{
+    return (key_sz < 2) ? 1 : std::min(size_t(1) << (key_sz / 2), RadixKeyScanner<size_t>::m_max_runs_limit);
+}
+
+constexpr size_t RadixBitWidth(uint64_t val)
+{
+    size_t width = 0;
+    for (; val; val >>= 1) ++width;
+    return width;
+}
+
+// The rounds of an LSD sort of keys in the range [0, key_range]: how many, and the bits of the digit of each.
+struct RadixRoundsPlan
+{
+    size_t  m_rounds;
+    size_t  m_digit_bits;
+};
+
+// Wider digits mean fewer rounds, but a scatter to more buckets at once, which is slower.
+constexpr size_t RadixMaxDigitBits = 8;
+
+// The counters of a round with a digit of up to this many bits are on the stack (see RadixHistogram).
+constexpr size_t RadixStackCounterBits = 11;
+
+// Whether the sorts running on this thread may allocate only the helper memory that they were given or that was
+// counted in advance (see RadixStrictMemoryScope).
+inline bool &RadixCurStrictMemory()
+{
+    thread_local bool strict = false;
+    return strict;
+}
+
+inline RadixRoundsPlan RadixPlanRounds(uint64_t key_range, size_t sz)
+{
+    // a single round, when the range is up to 2^16 keys and the histogram is not larger than the input.
+    // Under strict memory, only when its histogram is on the stack.
+    const size_t max_single_round_bits = RadixCurStrictMemory() ? RadixStackCounterBits : 16;
+
+    const size_t bits = RadixBitWidth(key_range);
+    if (0 == bits) {
+        return {0, 0};
+    }
+    if ((bits <= max_single_round_bits) && ((size_t(1) << bits) <= std::max(size_t(1) << RadixStackCounterBits, sz))) {
+        return {1, bits};
+    }
+
+    const size_t rounds = (bits + RadixMaxDigitBits - 1) / RadixMaxDigitBits;
+    return {rounds, (bits + rounds - 1) / rounds};
+}
+
+// Bucket counters of a counting round: on the stack for up to 2^11 buckets, dynamically allocated above that.
+class RadixHistogram
+{
+public:
+    explicit RadixHistogram(size_t num_buckets) : m_num_buckets(num_buckets)
+    {
+        if (num_buckets > m_stack_buckets) {
+            m_heap.assign(num_buckets, 0);
+            m_buckets = m_heap.data();
+        }
+        else {
+            std::fill_n(m_stack, num_buckets, 0);
+        }
+    }
+
+    RadixHistogram(const RadixHistogram&) = delete;
+    RadixHistogram& operator=(const RadixHistogram&) = delete;
+
+    size_t &operator[](size_t bucket) { return m_buckets[bucket]; }
+
+    // Turn the counts into the offsets of the buckets in the output.
+    // Return: false if all the num_elements counted are in one bucket, in which case the counts are kept.
+    bool ToOffsets(size_t num_elements)
+    {
+        for (size_t i = 0, offset = 0; i < m_num_buckets; ++i) {
+            const size_t bucket_sz = m_buckets[i];
+            if (bucket_sz == num_elements) return false;
+            m_buckets[i] = offset;
+            offset += bucket_sz;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t m_stack_buckets = size_t(1) << RadixStackCounterBits;
+
+    size_t              m_num_buckets;
+    size_t              m_stack[m_stack_buckets];
+    std::vector<size_t> m_heap;
+    size_t             *m_buckets = m_stack;
+};
+
+// Merge stably the consecutive sorted runs of arr, that start at run_begins, pairwise.
+// Return: arr or helper, whichever holds the merged result.
+template <class T, class LESS>
+T *RadixMergeRuns(T *arr, T *helper, size_t sz, size_t *run_begins, size_t num_runs, const LESS &less)
+{
+    RADIX_STATS_PHASE(m_merge, sz);
+
+    while (num_runs > 1) {
+        size_t num_merged = 0;
+        for (size_t run = 0; run < num_runs; run += 2, ++num_merged) {
+            const size_t begin = run_begins[run];
+            const size_t mid = (run + 1 < num_runs) ? run_begins[run + 1] : sz;
+            const size_t end = (run + 2 < num_runs) ? run_begins[run + 2] : sz;
+            std::merge(arr + begin, arr + mid, arr + mid, arr + end, helper + begin, less);
+            run_begins[num_merged] = begin;
+        }
+        RADIX_STATS_ADD(m_bytes_moved, sz * sizeof(T));
+        num_runs = num_merged;
+        std::swap(arr, helper);
+    }
+
+    return arr;
 }
 
+// Return: false if the round was skipped, since all the elements have the same digit.
+// In that case out_arr is left untouched, and arr holds the result of the round.
+// The digit of a value is taken from (value - min_val), which is never negative.
 template<class T>
-void CountingIntegral(
+bool CountingIntegral(
         const T *arr,
         size_t   arr_sz,
-        size_t   cur_byte_idx,
+        size_t   shift_bits,
+        size_t   digit_bits,
+        T        min_val,
         T       *out_arr)
 {
-    size_t histogram[256] = {0};
-    const size_t shift_bits = (cur_byte_idx - 1) * 8;
-    const size_t mask = ~(size_t)0 >> ((sizeof(size_t) - cur_byte_idx) * 8);
+    using unsigned_t = std::make_unsigned_t<T>;
 
-    for (size_t i = 0; i < arr_sz; ++i) {
-        ++histogram[(arr[i] & mask) >> shift_bits];
+    if (arr_sz < 2) return false;
+
+    const size_t mask = (size_t(1) << digit_bits) - 1;
+    const auto digit = [=](T val) {
+        return ((size_t)(unsigned_t)((unsigned_t)val - (unsigned_t)min_val) >> shift_bits) & mask;
+    };
+    RadixHistogram histogram(mask + 1);
+
+    {
+        RADIX_STATS_PHASE(m_histogram, arr_sz);
+        for (size_t i = 0; i < arr_sz; ++i) {
+            ++histogram[digit(arr[i])];
+        }
     }
 
-    for (size_t i = 0, offset = 0; i < 256; ++i) {
-        const size_t bucket_sz = histogram[i];
-        histogram[i] = offset;
-        offset += bucket_sz;
+    if (!histogram.ToOffsets(arr_sz)) {
+        RADIX_STATS_ADD(m_rounds_skipped, 1);
+        return false;
     }
 
+    RADIX_STATS_PHASE(m_scatter, arr_sz);
+    RADIX_STATS_ADD(m_rounds, 1);
+    RADIX_STATS_ADD(m_bytes_moved, arr_sz * sizeof(T));
     for (size_t i = 0; i < arr_sz; ++i) {
-        const size_t idx = (arr[i] & mask) >> shift_bits;
+        const size_t idx = digit(arr[i]);
         out_arr[histogram[idx]] = arr[i];
         ++histogram[idx];
     }
+
+    return true;
+}
+
+// Copy the distinct values of the sorted src to dst, which may be src itself.
+// Return: The number of distinct values.
+template <class T>
+size_t RadixCopyUnique(const T *src, size_t sz, T *dst)
+{
+    if (0 == sz) return 0;
+
+    size_t num_unique = 1;
+    dst[0] = src[0];
+    for (size_t i = 1; i < sz; ++i) {
+        if (src[i] != dst[num_unique - 1]) {
+            dst[num_unique++] = src[i];
+        }
+    }
+    return num_unique;
+}
+
+// Sort values in the range [min_val, min_val + key_range] by counting each value, and then writing
+// the values back in order. Needs no helper memory, since equal integral values are indistinguishable.
+// If unique, each value is written back once.
+// Return: The number of values written back.
+template<class T>
+size_t CountingIntegralInPlace(T *arr, size_t arr_sz, T min_val, size_t key_range, bool unique)
+{
+    using unsigned_t = std::make_unsigned_t<T>;
+
+    RadixHistogram histogram(key_range + 1);
+    {
+        RADIX_STATS_PHASE(m_histogram, arr_sz);
+        for (size_t i = 0; i < arr_sz; ++i) {
+            ++histogram[(unsigned_t)((unsigned_t)arr[i] - (unsigned_t)min_val)];
+        }
+    }
+
+    RADIX_STATS_PHASE(m_scatter, arr_sz);
+    RADIX_STATS_ADD(m_rounds, 1);
+    RADIX_STATS_ADD(m_bytes_moved, arr_sz * sizeof(T));
+    T *out = arr;
+    for (size_t key = 0; key <= key_range; ++key) {
+        const size_t count = unique ? std::min<size_t>(histogram[key], 1) : histogram[key];
+        out = std::fill_n(out, count, (T)((unsigned_t)min_val + (unsigned_t)key));
+    }
+    return out - arr;
+}
+
+// A thread is given at least this many elements to work on, otherwise starting it costs more than it saves.
+constexpr size_t RadixMinElementsPerThread = size_t(1) << 14;
+
+// Call run(thread_idx) for each thread_idx in [0, num_threads), each on a thread of its own, the calling thread
+// running thread 0. If a thread cannot be started, its run is called by the calling thread instead.
+// An exception thrown by any of the runs is rethrown here, once all of them are done.
+template <class RUN>
+void RadixRunThreads(size_t num_threads, const RUN &run)
+{
+    if (num_threads < 2) {
+        run(0);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(num_threads);
+    const auto run_catch = [&](size_t t) {
+        try {
+            run(t);
+        }
+        catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(num_threads - 1);
+    for (size_t t = 1; t < num_threads; ++t) {
+        try {
+            threads.emplace_back(run_catch, t);
+        }
+        catch (...) {
+            run_catch(t);
+        }
+    }
+    run_catch(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (const auto &error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
+
+// The largest digit that RadixPartition partitions by: 2^16 buckets.
+constexpr size_t RadixPartitionMaxBits = 16;
+
+// Write-combining buffers are one cache line per bucket.
+constexpr size_t RadixCacheLineBytes = 64;
+
+// Write a line of out from a line aligned buffer. With SSE2, by streaming stores, which do not read the line of out
+// into the cache first (see RadixScatterCombining, which fences them).
+inline void RadixStreamLine(void *dst, const void *src)
+{
+#ifdef __SSE2__
+    const __m128i *from = (const __m128i*)src;
+    __m128i *to = (__m128i*)dst;
+    for (size_t i = 0; i < RadixCacheLineBytes / sizeof(__m128i); ++i) {
+        _mm_stream_si128(to + i, from[i]);
+    }
+#else
+    std::memcpy(dst, src, RadixCacheLineBytes);
+#endif
+}
+
+// Scatter in[begin, end) to out by digit, offsets being the next place in out of each bucket.
+// The elements of each bucket are first collected in a line aligned buffer of a cache line, each at the place that it
+// will have within its line of out. A full buffer is then a whole aligned line of out, and is written at once, by
+// RadixStreamLine. The lines at the ends of a bucket's range, which it shares with other buckets (or other threads),
+// are written partially, as usual.
+// Requires sizeof(T) to divide the cache line, and out to be aligned to sizeof(T). Otherwise, scatters as usual.
+template <class T, class DIGIT>
+void RadixScatterCombining(
+        const T                 *in,
+        size_t                   begin,
+        size_t                   end,
+        const DIGIT             &digit,
+        T                       *out,
+        size_t                  *offsets,
+        size_t                   num_buckets)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "write combining requires a trivially copyable type");
+    constexpr bool fits_line = (sizeof(T) <= RadixCacheLineBytes) && (0 == RadixCacheLineBytes % sizeof(T));
+
+    if constexpr (!fits_line) {
+        for (size_t i = begin; i < end; ++i) {
+            out[offsets[digit(in[i])]++] = in[i];
+        }
+    }
+    else {
+        if ((uintptr_t)out % sizeof(T)) {
+            for (size_t i = begin; i < end; ++i) {
+                out[offsets[digit(in[i])]++] = in[i];
+            }
+            return;
+        }
+
+        constexpr size_t line_sz = RadixCacheLineBytes / sizeof(T);
+        // places are counted from the beginning of the line of out[0], out[0] being at place line_begin.
+        const size_t line_begin = ((uintptr_t)out / sizeof(T)) % line_sz;
+        const auto to_out = [=](size_t place) { return out + (place - line_begin); };
+
+        auto raw_buffers = GetRawMem<T>((num_buckets + 1) * line_sz);
+        const uintptr_t line_mask = RadixCacheLineBytes - 1;
+        T *buffers = (T*)(((uintptr_t)raw_buffers.get() + line_mask) & ~line_mask);
+        // the place of the first element of each bucket in this range.
+        std::vector<size_t> firsts(num_buckets);
+        for (size_t bucket = 0; bucket < num_buckets; ++bucket) {
+            firsts[bucket] = line_begin + offsets[bucket];
+        }
+
+        for (size_t i = begin; i < end; ++i) {
+            const size_t bucket = digit(in[i]);
+            const size_t place = line_begin + offsets[bucket]++;
+            T *buffer = buffers + bucket * line_sz;
+            std::memcpy((void*)(buffer + place % line_sz), (const void*)(in + i), sizeof(T));
+
+            if (place % line_sz == line_sz - 1) {
+                const size_t line_first = place + 1 - line_sz;
+                if (line_first >= firsts[bucket]) {
+                    RadixStreamLine(to_out(line_first), buffer);
+                }
+                else {
+                    const size_t first = firsts[bucket];
+                    std::memcpy((void*)to_out(first), (const void*)(buffer + first % line_sz),
+                                (place + 1 - first) * sizeof(T));
+                }
+            }
+        }
+#ifdef __SSE2__
+        _mm_sfence();
+#endif
+
+        // the last, partial, line of each bucket. An empty one is not copied, since out may be nullptr when there is
+        // nothing to output.
+        for (size_t bucket = 0; bucket < num_buckets; ++bucket) {
+            const size_t next = line_begin + offsets[bucket];
+            const size_t first = std::max(next - next % line_sz, firsts[bucket]);
+            if (next == first) continue;
+            std::memcpy((void*)to_out(first), (const void*)(buffers + bucket * line_sz + first % line_sz),
+                        (next - first) * sizeof(T));
+        }
+    }
+}
+
+// Copy in to out, stably partitioned into num_buckets buckets by digit(element), and set bucket_begins[b] to the place
+// in out of bucket b (and bucket_begins[num_buckets] to sz). in is split to up to num_threads consecutive ranges:
+// each thread counts the digits of its range, and then scatters it, to places that keep the ranges in order within
+// each bucket.
+template <class T, class DIGIT>
+void RadixPartitionImpl(
+        const T                 *in,
+        size_t                   sz,
+        size_t                   num_buckets,
+        const DIGIT             &digit,
+        T                       *out,
+        size_t                  *bucket_begins,
+        size_t                   num_threads,
+        bool                     write_combining)
+{
+    num_threads = std::max<size_t>(1, std::min(num_threads, sz / RadixMinElementsPerThread));
+    const auto range = [=](size_t t) {
+        return std::make_pair(sz * t / num_threads, sz * (t + 1) / num_threads);
+    };
+
+    // offsets[t * num_buckets + b]: the count, and then the place in out, of the elements of thread t in bucket b.
+    // On the stack, unless there are more than 2^11 of them.
+    RadixHistogram offsets(num_threads * num_buckets);
+    {
+        RADIX_STATS_PHASE(m_histogram, sz);
+        RadixRunThreads(num_threads, [&](size_t t) {
+            size_t *counts = &offsets[t * num_buckets];
+            const auto [begin, end] = range(t);
+            for (size_t i = begin; i < end; ++i) {
+                ++counts[digit(in[i])];
+            }
+        });
+    }
+
+    for (size_t b = 0, offset = 0; b < num_buckets; ++b) {
+        bucket_begins[b] = offset;
+        for (size_t t = 0; t < num_threads; ++t) {
+            const size_t count = offsets[t * num_buckets + b];
+            offsets[t * num_buckets + b] = offset;
+            offset += count;
+        }
+    }
+    bucket_begins[num_buckets] = sz;
+
+    RADIX_STATS_PHASE(m_scatter, sz);
+    RADIX_STATS_ADD(m_rounds, 1);
+    RADIX_STATS_ADD(m_bytes_moved, sz * sizeof(T));
+    RadixRunThreads(num_threads, [&](size_t t) {
+        size_t *thread_offsets = &offsets[t * num_buckets];
+        const auto [begin, end] = range(t);
+        if constexpr (std::is_trivially_copyable<T>::value) {
+            if (write_combining) {
+                RadixScatterCombining(in, begin, end, digit, out, thread_offsets, num_buckets);
+                return;
+            }
+        }
+        for (size_t i = begin; i < end; ++i) {
+            out[thread_offsets[digit(in[i])]++] = in[i];
+        }
+    });
 }
 
+// Above this size, a sort of several rounds first partitions by its most significant digit, and then sorts each bucket
+// by the other digits while it is in cache, rather than going through memory in every round. A bucket and the part of
+// the helper memory that it is sorted with should fit in L2 together.
+constexpr size_t RadixCacheBlockBytes = size_t(1) << 20;
+
+// unique: Keep only one of each value, at the beginning of arr.
+// Return: The number of (sorted) values in arr.
 template<class T>
-void RadixIntegral(T *arr, size_t sz, void *helper_arr = nullptr)
+size_t RadixIntegral(T *arr, size_t sz, void *helper_arr = nullptr, bool unique = false)
 {
-    // 1. rearrange arr: min values of type T, then negative values, then positive values.
-    // 2. turn only the part of the negative values into positive values.
-    // 3. sort the negative part separately and the positive part separately.
-    // 4. turn the values in the negative part back to negative, and reverse them.
+    // 1. scan arr for sorted runs, and for its min and max values.
+    // 2. if arr is presorted (already sorted, reverse sorted, or a few sorted runs), finish accordingly.
+    // 3. otherwise sort by (value - min), which needs no special handling of negative values,
+    //    in as few rounds as the bit width of (max - min) allows, rather than in sizeof(T) rounds.
+    // If unique, the duplicates are dropped while copying the result to arr (or in place, if it is there).
+
+    using unsigned_t = std::make_unsigned_t<T>;
+
+    if (sz < 2) return sz;
 
-    T *pos_begin = arr;
-    for (T *p = arr, *p_end = arr + sz; p < p_end; ++p) {
-        if (*p < 0) {
-            std::swap(*pos_begin, *p);
-            ++pos_begin;
+    RadixKeyScanner<T> scanner(RadixMaxMergeRuns(sizeof(T)), false);
+    {
+        RADIX_STATS_PHASE(m_key_scan, sz);
+        scanner.Start(arr[0]);
+        size_t i = 1;
+        for (; (i < sz) && !scanner.IsHopeless(); ++i) {
+            scanner.Add(i, arr[i], arr[i - 1]);
         }
+        for (; i < sz; ++i) {
+            scanner.AddMinMax(arr[i]);
+        }
+    }
+
+    if (scanner.IsSorted()) {
+        RADIX_STATS_ADD(m_presorted, 1);
+        return unique ? RadixCopyUnique(arr, sz, arr) : sz;
+    }
+    if (scanner.IsDescending()) {
+        RADIX_STATS_ADD(m_reversed, 1);
+        std::reverse(arr, arr + sz);
+        return unique ? RadixCopyUnique(arr, sz, arr) : sz;
     }
 
-    const T t_min = std::numeric_limits<T>::min();
-    T *neg_begin = arr;
-    for (T *p = arr; p < pos_begin; ++p) {
-        if (t_min == *p) {
-            std::swap(*neg_begin, *p);
-            ++neg_begin;
+    const T min_val = scanner.Min();
+    const unsigned_t key_range = (unsigned_t)scanner.Max() - (unsigned_t)min_val;
+    const RadixRoundsPlan plan = RadixPlanRounds(key_range, sz);
+
+    RadixCheckCancelled();
+
+    if (scanner.HasFewRuns() && (RadixBitWidth(scanner.NumRuns() - 1) < plan.m_rounds)) {
+        auto helper = GetMem<T>(sz, helper_arr);
+        const T *merged = RadixMergeRuns(arr, helper.get(), sz, scanner.RunBegins(), scanner.NumRuns(), std::less<T>());
+        if (unique) {
+            return RadixCopyUnique(merged, sz, arr);
         }
-        else {
-            *p = -*p;
+        if (merged != arr) {
+            std::copy(merged, merged + sz, arr);
         }
+        return sz;
+    }
+
+    if (1 == plan.m_rounds) {
+        return CountingIntegralInPlace(arr, sz, min_val, key_range, unique);
     }
 
     auto out_arr = GetMem<T>(sz, helper_arr);
-    for (auto [round, out_neg_ptr, out_pos_ptr, pos_sz, neg_sz] = std::tuple{
-                1U,
-                out_arr.get() + (neg_begin - arr),
-                out_arr.get() + (pos_begin - arr),
-                sz - (pos_begin - arr),
-                pos_begin - neg_begin};
-        round <= sizeof(T);
-        ++round) {
-            CountingIntegral(neg_begin, neg_sz, round, out_neg_ptr);
-            CountingIntegral(pos_begin, pos_sz, round, out_pos_ptr);
 
-            std::swap(neg_begin, out_neg_ptr);
-            std::swap(pos_begin, out_pos_ptr);
+    if (sz * sizeof(T) > RadixCacheBlockBytes) {
+        // partition stably to out_arr by the top digit. Each bucket is then sorted by the other digits, with the same
+        // part of arr as its helper, and copied back, all while in cache. A bucket that is still too large for it is
+        // partitioned again.
+        const size_t num_buckets = size_t(1) << plan.m_digit_bits;
+        const size_t shift_bits = (plan.m_rounds - 1) * plan.m_digit_bits;
+        const auto digit = [=](T val) {
+            return ((size_t)(unsigned_t)((unsigned_t)val - (unsigned_t)min_val) >> shift_bits) & (num_buckets - 1);
+        };
+        size_t bucket_begins[(size_t(1) << RadixMaxDigitBits) + 1];
+        RadixPartitionImpl(arr, sz, num_buckets, digit, out_arr.get(), bucket_begins, 1, false);
+
+        size_t b = 0;
+        try {
+            for (; b < num_buckets; ++b) {
+                const size_t begin = bucket_begins[b];
+                const size_t end = bucket_begins[b + 1];
+                RadixIntegral(out_arr.get() + begin, end - begin, arr + begin);
+                RADIX_STATS_ADD(m_bytes_moved, (end - begin) * sizeof(T));
+                std::copy(out_arr.get() + begin, out_arr.get() + end, arr + begin);
+            }
+        }
+        catch (...) {
+            // cancelled, or out of memory: the buckets below b are in arr, and the others only in out_arr, bucket b
+            // included (a sort that is stopped leaves its array with all of its elements). Copy them back, so that
+            // arr is left with all of its elements, though in an unspecified order.
+            std::copy(out_arr.get() + bucket_begins[b], out_arr.get() + sz, arr + bucket_begins[b]);
+            throw;
+        }
+        return unique ? RadixCopyUnique(arr, sz, arr) : sz;
+    }
+
+    T *sorted = arr;
+    T *to_sort = out_arr.get();
+    for (size_t round = 0; round < plan.m_rounds; ++round) {
+        RadixCheckCancelled();
+        if (CountingIntegral(sorted, sz, round * plan.m_digit_bits, plan.m_digit_bits, min_val, to_sort)) {
+            std::swap(sorted, to_sort);
+        }
     }
 
-    for (T *neg_rev = pos_begin - 1; neg_begin <= neg_rev; ++neg_begin, --neg_rev) {
-        const T tmp = -*neg_begin;
-        *neg_begin = -*neg_rev;
-        *neg_rev = tmp;
+    // depending on the number of rounds that were not skipped, the result may have ended up in out_arr.
+    if (unique) {
+        RADIX_STATS_ADD(m_bytes_moved, sz * sizeof(T));
+        return RadixCopyUnique(sorted, sz, arr);
+    }
+    if (sorted != arr) {
+        RADIX_STATS_ADD(m_bytes_moved, sz * sizeof(T));
+        std::copy(sorted, sorted + sz, arr);
     }
+    return sz;
 }
 
 template<class LOC>
@@ -106,32 +787,64 @@ struct RadixEntry
     size_t  m_second;
 };
 
-template <class LOCATION_TYPE>
-void CountingUserDefined(
+// Return: false if the round was skipped, since all the elements have the same digit.
+// In that case nothing is scattered, and arr holds the result of the round.
+// The digit of an entry is taken from (m_second - min_key).
+// scatter(entry, idx) places each entry at its index in the result of the round.
+template <class LOCATION_TYPE, class SCATTER>
+bool CountingUserDefined(
         const RadixEntry<LOCATION_TYPE>  *arr,
         size_t                            arr_sz,
-        size_t                            round,
-        RadixEntry<LOCATION_TYPE>        *out)
+        size_t                            shift_bits,
+        size_t                            digit_bits,
+        size_t                            min_key,
+        const SCATTER                    &scatter)
 {
-    size_t histogram[256] = {0};
-    const size_t shift_bits = (round - 1) * 8;
-    const size_t mask = ~(size_t)0 >> ((sizeof(size_t) - round) * 8);
+    if (arr_sz < 2) return false;
 
-    for (size_t i = 0; i < arr_sz; ++i) {
-        ++histogram[(arr[i].m_second & mask) >> shift_bits];
+    const size_t mask = (size_t(1) << digit_bits) - 1;
+    RadixHistogram histogram(mask + 1);
+
+    {
+        RADIX_STATS_PHASE(m_histogram, arr_sz);
+        for (size_t i = 0; i < arr_sz; ++i) {
+            ++histogram[((arr[i].m_second - min_key) >> shift_bits) & mask];
+        }
     }
 
-    for (size_t i = 0, offset = 0; i < 256; ++i) {
-        const size_t bucket_sz = histogram[i];
-        histogram[i] = offset;
-        offset += bucket_sz;
+    if (!histogram.ToOffsets(arr_sz)) {
+        RADIX_STATS_ADD(m_rounds_skipped, 1);
+        return false;
     }
 
+    RADIX_STATS_PHASE(m_scatter, arr_sz);
+    RADIX_STATS_ADD(m_rounds, 1);
+    RADIX_STATS_ADD(m_bytes_moved, arr_sz * sizeof(RadixEntry<LOCATION_TYPE>));
     for (size_t i = 0; i < arr_sz; ++i) {
-        const size_t idx = (arr[i].m_second & mask) >> shift_bits;
-        out[histogram[idx]] = arr[i];
+        const size_t idx = ((arr[i].m_second - min_key) >> shift_bits) & mask;
+        scatter(arr[i], histogram[idx]);
         ++histogram[idx];
     }
+
+    return true;
+}
+
+template <class LOCATION_TYPE>
+bool CountingUserDefined(
+        const RadixEntry<LOCATION_TYPE>  *arr,
+        size_t                            arr_sz,
+        size_t                            shift_bits,
+        size_t                            digit_bits,
+        size_t                            min_key,
+        RadixEntry<LOCATION_TYPE>        *out)
+{
+    return CountingUserDefined(
+        arr,
+        arr_sz,
+        shift_bits,
+        digit_bits,
+        min_key,
+        [out](const RadixEntry<LOCATION_TYPE> &entry, size_t idx) { out[idx] = entry; });
 }
 
 template<class T>
@@ -147,11 +860,19 @@ void RearrangeArr(
     // m_first: current idx of residence of the element that originally resided here.
     // m_second: original idx of residence of the element that currently resides here.
 
-    for (size_t i = 0; i < arr_sz; ++i) {
+    RADIX_STATS_PHASE(m_rearrange, arr_sz);
+
+    // elements that are already in place never move, and are never looked up in locs.
+    size_t in_place = 0;
+    while ((in_place < arr_sz) && (sorted[in_place].m_first == in_place)) {
+        ++in_place;
+    }
+
+    for (size_t i = in_place; i < arr_sz; ++i) {
         locs[i].m_first = locs[i].m_second = i;
     }
 
-    for (size_t i = 0; i < arr_sz - 1; ++i) {
+    for (size_t i = in_place; i + 1 < arr_sz; ++i) {
         size_t where_is_elem = locs[sorted[i].m_first].m_first;
 
         if (i != where_is_elem) {
@@ -161,59 +882,275 @@ void RearrangeArr(
             T tmp = std::move(arr[i]);
             arr[i] = std::move(arr[where_is_elem]);
             arr[where_is_elem] = std::move(tmp);
+            RADIX_STATS_ADD(m_bytes_moved, 3 * sizeof(T));
         }
     }
 }
 
-template <class U, class LOCATION_TYPE, class T_ITERAROT, class INIT_FUNC>
-void RadixImpl(
+// An init_radix_entry of RadixImpl for entries that are already in place, when it sorts entries rather than elements.
+struct RadixKeepEntry
+{
+    template <class ENTRY, class IT>
+    void operator()(ENTRY&, IT, size_t) const {}
+};
+
+// A final_scatter of RadixImpl for a part of the entries that starts at offset: scatters to offset + idx.
+// Offsets of offsets are added up, rather than wrapped, so that sorting parts of parts uses the same type.
+template <class SCATTER>
+struct RadixOffsetScatter
+{
+    const SCATTER  *m_scatter;
+    size_t          m_offset;
+
+    template <class ENTRY>
+    void operator()(const ENTRY &entry, size_t idx) const { (*m_scatter)(entry, m_offset + idx); }
+};
+
+template <class SCATTER>
+RadixOffsetScatter<SCATTER> RadixOffsetScatterOf(const SCATTER &scatter, size_t offset)
+{
+    return {&scatter, offset};
+}
+
+template <class SCATTER>
+RadixOffsetScatter<SCATTER> RadixOffsetScatterOf(const RadixOffsetScatter<SCATTER> &scatter, size_t offset)
+{
+    return {scatter.m_scatter, scatter.m_offset + offset};
+}
+
+// final_scatter: If given, the last round scatters with it (see CountingUserDefined) instead of into memory,
+// so that the output can be written directly from that round.
+// Return: The sorted entries, and the other memory, which is free for use.
+// Since rounds may be skipped, each of them may be either of the two given memories.
+// The sorted entries are nullptr if the last round was scattered with final_scatter. If it wasn't (the round
+// was skipped, or the input was presorted), the output should be prepared from the sorted entries.
+template <class U, class LOCATION_TYPE, class T_ITERAROT, class INIT_FUNC, class FINAL_SCATTER = std::nullptr_t>
+std::pair<RadixEntry<LOCATION_TYPE>*, RadixEntry<LOCATION_TYPE>*> RadixImpl(
         T_ITERAROT                   it,
         size_t                       sz,
         RadixEntry<LOCATION_TYPE>   *sorted,
         RadixEntry<LOCATION_TYPE>   *to_sort,
-        const INIT_FUNC             &init_radix_entry)
+        const INIT_FUNC             &init_radix_entry,
+        const FINAL_SCATTER         &final_scatter = nullptr)
 {
-    for (size_t i = 0; i < sz; ++it, ++i) {
-        init_radix_entry(sorted[i], it, i);
+    // strictly descending only, for reversing equal keys would break stability.
+    RadixKeyScanner<size_t> scanner(RadixMaxMergeRuns(sizeof(U)), true);
+    {
+        RADIX_STATS_PHASE(m_key_extraction, sz);
+        if (sz) {
+            init_radix_entry(sorted[0], it, 0);
+            scanner.Start(sorted[0].m_second);
+            ++it;
+        }
+        size_t i = 1;
+        for (; (i < sz) && !scanner.IsHopeless(); ++it, ++i) {
+            init_radix_entry(sorted[i], it, i);
+            scanner.Add(i, sorted[i].m_second, sorted[i - 1].m_second);
+        }
+        for (; i < sz; ++it, ++i) {
+            init_radix_entry(sorted[i], it, i);
+            scanner.AddMinMax(sorted[i].m_second);
+        }
     }
 
-    for (size_t round = 1, rounds = std::max(size_t(2), sizeof(U)); round <= rounds; ++round) {
-        CountingUserDefined(sorted, sz, round, to_sort);
-        std::swap(to_sort, sorted);
+    if (scanner.IsSorted()) {
+        RADIX_STATS_ADD(m_presorted, 1);
+        return {sorted, to_sort};
+    }
+    if (scanner.IsDescending()) {
+        RADIX_STATS_ADD(m_reversed, 1);
+        std::reverse(sorted, sorted + sz);
+        return {sorted, to_sort};
     }
-}
 
-template <class U, class T, class PREPARE_OUTPUT>
-void RadixConsecutive(
-        const T                 *arr,
-        size_t                   arr_sz,
-        U                       (T_to_unsigned)(const T&),
-        PREPARE_OUTPUT           prepare_output,
-        void                    *usable_mem1 = nullptr,
-        void                    *usable_mem2 = nullptr)
-{
-    using radix_entry_t = RadixEntry<size_t>;
+    // sort by (key - min), in as few rounds as the bit width of (max - min) allows.
+    const size_t min_key = scanner.Min();
+    const RadixRoundsPlan plan = RadixPlanRounds(scanner.Max() - min_key, sz);
 
-    auto sorted = GetMem<radix_entry_t>(arr_sz, usable_mem1);
-    auto to_sort = GetMem<radix_entry_t>(arr_sz, usable_mem2);
-    const auto init_radix_entry =
+    RadixCheckCancelled();
+
+    if (scanner.HasFewRuns() && (RadixBitWidth(scanner.NumRuns() - 1) < plan.m_rounds)) {
+        const auto less = [](const RadixEntry<LOCATION_TYPE> &lhs, const RadixEntry<LOCATION_TYPE> &rhs) {
+            return lhs.m_second < rhs.m_second;
+        };
+        auto *merged = RadixMergeRuns(sorted, to_sort, sz, scanner.RunBegins(), scanner.NumRuns(), less);
+        return {merged, (merged == sorted) ? to_sort : sorted};
+    }
+
+    if ((plan.m_rounds > 1) && (sz * sizeof(RadixEntry<LOCATION_TYPE>) > RadixCacheBlockBytes)) {
+        // as in RadixIntegral: partition stably by the top digit, and sort each bucket by the other digits while it
+        // is in cache. Both steps are stable, and so is the whole. With final_scatter, each bucket is scattered by
+        // its own last round, or from its sorted entries if that round was skipped.
+        using entry_t = RadixEntry<LOCATION_TYPE>;
+        const size_t num_buckets = size_t(1) << plan.m_digit_bits;
+        const size_t shift_bits = (plan.m_rounds - 1) * plan.m_digit_bits;
+        size_t bucket_begins[(size_t(1) << RadixMaxDigitBits) + 1];
+        RadixPartitionImpl(
+            sorted,
+            sz,
+            num_buckets,
+            [=](const entry_t &entry) { return ((entry.m_second - min_key) >> shift_bits) & (num_buckets - 1); },
+            to_sort,
+            bucket_begins,
+            1,
+            false);
+
+        for (size_t b = 0; b < num_buckets; ++b) {
+            const size_t begin = bucket_begins[b];
+            const size_t bucket_sz = bucket_begins[b + 1] - begin;
+
+            if constexpr (!std::is_null_pointer<FINAL_SCATTER>::value) {
+                const entry_t *bucket = RadixImpl<U>(
+                    to_sort + begin,
+                    bucket_sz,
+                    to_sort + begin,
+                    sorted + begin,
+                    RadixKeepEntry(),
+                    RadixOffsetScatterOf(final_scatter, begin)).first;
+                for (size_t i = 0; bucket && (i < bucket_sz); ++i) {
+                    final_scatter(bucket[i], begin + i);
+                }
+            }
+            else {
+                const entry_t *bucket = RadixImpl<U>(
+                    to_sort + begin, bucket_sz, to_sort + begin, sorted + begin, RadixKeepEntry()).first;
+                if (bucket != to_sort + begin) {
+                    RADIX_STATS_ADD(m_bytes_moved, bucket_sz * sizeof(entry_t));
+                    std::copy(bucket, bucket + bucket_sz, to_sort + begin);
+                }
+            }
+        }
+
+        if constexpr (!std::is_null_pointer<FINAL_SCATTER>::value) {
+            return {nullptr, to_sort};
+        }
+        return {to_sort, sorted};
+    }
+
+    for (size_t round = 0; round < plan.m_rounds; ++round) {
+        RadixCheckCancelled();
+        const size_t shift_bits = round * plan.m_digit_bits;
+
+        if constexpr (!std::is_null_pointer<FINAL_SCATTER>::value) {
+            if (round + 1 == plan.m_rounds) {
+                if (CountingUserDefined(sorted, sz, shift_bits, plan.m_digit_bits, min_key, final_scatter)) {
+                    return {nullptr, to_sort};
+                }
+                break;
+            }
+        }
+
+        if (CountingUserDefined(sorted, sz, shift_bits, plan.m_digit_bits, min_key, to_sort)) {
+            std::swap(to_sort, sorted);
+        }
+    }
+
+    return {sorted, to_sort};
+}
+
+// final_scatter: See RadixImpl. If the last round was scattered with it, prepare_output gets nullptr as the sorted entries.
+template <class U, class T, class PREPARE_OUTPUT, class FINAL_SCATTER = std::nullptr_t>
+void RadixConsecutive(
+        const T                 *arr,
+        size_t                   arr_sz,
+        U                       (T_to_unsigned)(const T&),
+        PREPARE_OUTPUT           prepare_output,
+        void                    *usable_mem1 = nullptr,
+        void                    *usable_mem2 = nullptr,
+        const FINAL_SCATTER     &final_scatter = nullptr)
+{
+    using radix_entry_t = RadixEntry<size_t>;
+
+    auto sorted = GetMem<radix_entry_t>(arr_sz, usable_mem1);
+    auto to_sort = GetMem<radix_entry_t>(arr_sz, usable_mem2);
+    const auto init_radix_entry =
         [&T_to_unsigned](radix_entry_t &entry, const T *it_to_elem, size_t elem_idx){
             entry.m_first = elem_idx;
             entry.m_second = T_to_unsigned(*it_to_elem);
     };
-    RadixImpl<U>(
+    const auto [sorted_entries, helper_memory] = RadixImpl<U>(
         arr,
         arr_sz,
         sorted.get(),
         to_sort.get(),
-        init_radix_entry);
+        init_radix_entry,
+        final_scatter);
 
-    prepare_output(sorted.get(), to_sort.get());
+    prepare_output(sorted_entries, helper_memory);
+}
+
+// Output the sorted indexes (the position in arr of the element at each sorted position),
+// or the ranks (the sorted position of the element at each position in arr), as type IDX.
+// Writes directly from the last round when possible, see RadixImpl.
+template <class U, class T, class IDX>
+void RadixIndexesImpl(
+        const T                 *arr,
+        size_t                   arr_sz,
+        U                       (T_to_unsigned)(const T&),
+        IDX                     *out,
+        bool                     ranks,
+        void                    *usable_mem1,
+        void                    *usable_mem2)
+{
+    const auto prepare_output = [=](RadixEntry<size_t> *sorted, RadixEntry<size_t> *) {
+        if (!sorted) return;
+
+        for (size_t i = 0; i < arr_sz; ++i) {
+            if (ranks) {
+                out[sorted[i].m_first] = (IDX)i;
+            }
+            else {
+                out[i] = (IDX)sorted[i].m_first;
+            }
+        }
+    };
+
+    if (ranks) {
+        RadixConsecutive(arr, arr_sz, T_to_unsigned, prepare_output, usable_mem1, usable_mem2,
+            [out](const RadixEntry<size_t> &entry, size_t idx) { out[entry.m_first] = (IDX)idx; });
+    }
+    else {
+        RadixConsecutive(arr, arr_sz, T_to_unsigned, prepare_output, usable_mem1, usable_mem2,
+            [out](const RadixEntry<size_t> &entry, size_t idx) { out[idx] = (IDX)entry.m_first; });
+    }
+}
+
+// Write the sorted indexes to out, and the equal-key groups of the sorted entries, in the same pass.
+// Each of group_begins, group_sizes and group_keys may be nullptr, if not needed.
+// Return: The number of groups.
+template <class U>
+size_t RadixGroupOutput(
+        const RadixEntry<size_t>    *sorted,
+        size_t                       sz,
+        size_t                      *out,
+        size_t                      *group_begins,
+        size_t                      *group_sizes,
+        U                           *group_keys)
+{
+    size_t num_groups = 0;
+    size_t group_begin = 0;
+
+    for (size_t i = 0; i < sz; ++i) {
+        out[i] = sorted[i].m_first;
+
+        if ((0 == i) || (sorted[i].m_second != sorted[i - 1].m_second)) {
+            if (num_groups && group_sizes) group_sizes[num_groups - 1] = i - group_begin;
+            if (group_begins) group_begins[num_groups] = i;
+            if (group_keys) group_keys[num_groups] = (U)sorted[i].m_second;
+            group_begin = i;
+            ++num_groups;
+        }
+    }
+    if (num_groups && group_sizes) group_sizes[num_groups - 1] = sz - group_begin;
+
+    return num_groups;
 }
 
 template<class U, class T, typename it_t = typename std::list<T>::const_iterator>
 void RearrangeList(std::list<T> &lst, size_t lst_sz, RadixEntry<it_t> *sorted)
 {
+    RADIX_STATS_PHASE(m_rearrange, lst_sz);
+
     auto *it_sorted = sorted;
     auto *sorted_last = sorted + lst_sz - 1;
 
@@ -252,14 +1189,1022 @@ void RadixListImpl(
                 entry.m_first = it;
                 entry.m_second = T_to_unsigned(*it);
             };
-    RadixImpl<U>(
+    const auto sorted_entries = RadixImpl<U>(
         lst.begin(),
         lst_sz,
         sorted.get(),
         to_sort.get(),
-        init_radix_entry);
+        init_radix_entry).first;
+
+    RearrangeList<U>(lst, lst_sz, sorted_entries);
+}
+
+// Segments of up to these sizes are sorted by comparisons: below them, the setup of the counting rounds (mostly clearing
+// and scanning the histogram) costs more than the sort itself. Radix pays off sooner for elements sorted by their
+// keys, since a comparison sort of those goes through the keys as well.
+constexpr size_t RadixSegmentComparisonSortMax = 64;
+constexpr size_t RadixSegmentKeysComparisonSortMax = 32;
+
+// Segment s of the array is [segment_begins[s], segment_begins[s + 1]).
+// Return: false if the segment begins are decreasing. Otherwise max_segment_sz is set to the size of the largest segment.
+inline bool RadixSegmentsValid(const size_t *segment_begins, size_t num_segments, size_t &max_segment_sz)
+{
+    max_segment_sz = 0;
+    for (size_t s = 0; s < num_segments; ++s) {
+        if (segment_begins[s + 1] < segment_begins[s]) return false;
+        max_segment_sz = std::max(max_segment_sz, segment_begins[s + 1] - segment_begins[s]);
+    }
+    return true;
+}
+
+// The number of threads to sort the segments with, at most num_threads.
+inline size_t RadixSegmentsThreads(const size_t *segment_begins, size_t num_segments, size_t num_threads)
+{
+    const size_t num_elements = num_segments ? (segment_begins[num_segments] - segment_begins[0]) : 0;
+    return std::max<size_t>(1, std::min({num_threads, num_segments, num_elements / RadixMinElementsPerThread}));
+}
+
+// Call sort_segment(segment_begin, segment_sz, thread_idx) for each segment.
+// The segments are split to num_threads consecutive ranges of about the same number of elements, one per thread
+// (see RadixRunThreads). Each thread sorts with its own part of the scratch memory, found by thread_idx.
+// Note: Stats are collected only for the segments sorted by the calling thread.
+template <class SORT_SEGMENT>
+void RadixForEachSegment(
+        const size_t            *segment_begins,
+        size_t                   num_segments,
+        size_t                   num_threads,
+        const SORT_SEGMENT      &sort_segment)
+{
+    const auto sort_segments = [&](size_t first, size_t last, size_t thread_idx) {
+        for (size_t s = first; s < last; ++s) {
+            sort_segment(segment_begins[s], segment_begins[s + 1] - segment_begins[s], thread_idx);
+        }
+    };
+
+    if (num_threads < 2) {
+        sort_segments(0, num_segments, 0);
+        return;
+    }
+
+    const size_t first_elem = segment_begins[0];
+    const size_t num_elements = segment_begins[num_segments] - first_elem;
+    std::vector<size_t> thread_begins(num_threads + 1, num_segments);
+    for (size_t t = 0; t < num_threads; ++t) {
+        const size_t target = first_elem + (num_elements / num_threads) * t;
+        thread_begins[t] = std::lower_bound(segment_begins, segment_begins + num_segments, target) - segment_begins;
+    }
+
+    RadixRunThreads(num_threads, [&](size_t t) {
+        sort_segments(thread_begins[t], thread_begins[t + 1], t);
+    });
+}
+
+// Sort each segment of arr on its own, by std::sort if it is small, and by RadixIntegral otherwise.
+// All the segments sorted by a thread share its helper memory, of max_segment_sz elements.
+template <class T>
+void RadixSegmentsIntegral(
+        T                       *arr,
+        const size_t            *segment_begins,
+        size_t                   num_segments,
+        size_t                   max_segment_sz,
+        size_t                   num_threads,
+        void                    *usable_mem = nullptr)
+{
+    num_threads = RadixSegmentsThreads(segment_begins, num_segments, num_threads);
+    const size_t helper_sz = (max_segment_sz > RadixSegmentComparisonSortMax) ? max_segment_sz : 0;
+    auto helper = GetMem<T>(num_threads * helper_sz, usable_mem);
+
+    RadixForEachSegment(segment_begins, num_segments, num_threads,
+        [arr, helper_sz, &helper](size_t begin, size_t sz, size_t thread_idx) {
+            if (sz <= RadixSegmentComparisonSortMax) {
+                std::sort(arr + begin, arr + begin + sz);
+            }
+            else {
+                RadixIntegral(arr + begin, sz, helper.get() + thread_idx * helper_sz);
+            }
+        });
+}
+
+// Sort a segment stably by T_to_unsigned, with entries and locs of at least sz elements each:
+// by comparisons if it is small, and as RadixSort does otherwise.
+template <class U, class T>
+void RadixSegmentKeys(
+        T                       *segment,
+        size_t                   sz,
+        U                       (T_to_unsigned)(const T&),
+        RadixEntry<size_t>      *entries,
+        RadixEntry<size_t>      *locs)
+{
+    using radix_entry_t = RadixEntry<size_t>;
+
+    if (sz <= RadixSegmentKeysComparisonSortMax) {
+        // T_to_unsigned is called once per element, rather than once per comparison,
+        // and the index breaks the ties, for stability.
+        for (size_t i = 0; i < sz; ++i) {
+            entries[i].m_first = i;
+            entries[i].m_second = T_to_unsigned(segment[i]);
+        }
+        std::sort(entries, entries + sz, [](const radix_entry_t &lhs, const radix_entry_t &rhs) {
+            return (lhs.m_second < rhs.m_second) ||
+                   ((lhs.m_second == rhs.m_second) && (lhs.m_first < rhs.m_first));
+        });
+        RearrangeArr<T>(segment, sz, entries, locs);
+        return;
+    }
+
+    RadixConsecutive(
+        segment,
+        sz,
+        T_to_unsigned,
+        [segment, sz](radix_entry_t *sorted, radix_entry_t *helper_memory) {
+            RearrangeArr<T>(segment, sz, sorted, helper_memory);
+        },
+        entries,
+        locs);
+}
+
+// As RadixSegmentsIntegral, for any type T, sorting each segment with RadixSegmentKeys.
+template <class U, class T>
+void RadixSegmentsUserDefined(
+        T                       *arr,
+        const size_t            *segment_begins,
+        size_t                   num_segments,
+        size_t                   max_segment_sz,
+        U                       (T_to_unsigned)(const T&),
+        size_t                   num_threads,
+        void                    *usable_mem1 = nullptr,
+        void                    *usable_mem2 = nullptr)
+{
+    using radix_entry_t = RadixEntry<size_t>;
+
+    num_threads = RadixSegmentsThreads(segment_begins, num_segments, num_threads);
+    auto mem1 = GetMem<radix_entry_t>(num_threads * max_segment_sz, usable_mem1);
+    auto mem2 = GetMem<radix_entry_t>(num_threads * max_segment_sz, usable_mem2);
+
+    RadixForEachSegment(segment_begins, num_segments, num_threads,
+        [&, arr, max_segment_sz](size_t begin, size_t sz, size_t thread_idx) {
+            RadixSegmentKeys(
+                arr + begin,
+                sz,
+                T_to_unsigned,
+                mem1.get() + thread_idx * max_segment_sz,
+                mem2.get() + thread_idx * max_segment_sz);
+        });
+}
+
+// Reorder arr so that arr[i] is the element that was at arr[src_idx(i)], src_idx being a permutation of [0, sz).
+// Unlike the cycles of RearrangeArr, which are chased one element at a time, the elements are gathered into scratch
+// (raw memory of sz elements) and moved back, each of the two passes split between up to num_threads threads.
+// Each element is moved twice, rather than about three times by the swaps of RearrangeArr.
+template <class T, class SRC_IDX>
+void RadixGather(T *arr, size_t sz, const SRC_IDX &src_idx, T *scratch, size_t num_threads)
+{
+    RADIX_STATS_PHASE(m_rearrange, sz);
+
+    // elements that are already in place are left there.
+    size_t in_place = 0;
+    while ((in_place < sz) && (src_idx(in_place) == in_place)) {
+        ++in_place;
+    }
+    if (in_place == sz) return;
+
+    const size_t gather_sz = sz - in_place;
+    num_threads = std::max<size_t>(1, std::min(num_threads, gather_sz / RadixMinElementsPerThread));
+    const auto range = [=](size_t t) {
+        return std::make_pair(in_place + gather_sz * t / num_threads, in_place + gather_sz * (t + 1) / num_threads);
+    };
+
+    RadixRunThreads(num_threads, [&](size_t t) {
+        const auto [begin, end] = range(t);
+        for (size_t i = begin; i < end; ++i) {
+            new (scratch + i) T(std::move(arr[src_idx(i)]));
+        }
+    });
+    RadixRunThreads(num_threads, [&](size_t t) {
+        const auto [begin, end] = range(t);
+        for (size_t i = begin; i < end; ++i) {
+            arr[i] = std::move(scratch[i]);
+            scratch[i].~T();
+        }
+    });
+    RADIX_STATS_ADD(m_bytes_moved, 2 * gather_sz * sizeof(T));
+}
+
+// Sort arr as RadixSort does, rearranging it with RadixGather. The scratch of the gather is the free entries memory
+// when T fits in an entry, and usable_scratch (or dynamically allocated memory) otherwise.
+// With a single thread, the cycles of RearrangeArr are as fast, and need no scratch, so they are used instead.
+template <class U, class T>
+void RadixConsecutiveGather(
+        T                       *arr,
+        size_t                   arr_sz,
+        U                       (T_to_unsigned)(const T&),
+        size_t                   num_threads,
+        void                    *usable_mem1,
+        void                    *usable_mem2,
+        void                    *usable_scratch)
+{
+    using radix_entry_t = RadixEntry<size_t>;
+
+    constexpr bool fits_entry = (sizeof(T) <= sizeof(radix_entry_t)) && (alignof(T) <= alignof(radix_entry_t));
+
+    RadixConsecutive(
+        arr,
+        arr_sz,
+        T_to_unsigned,
+        [=](radix_entry_t *sorted, radix_entry_t *helper_memory) {
+            if (std::min(num_threads, arr_sz / RadixMinElementsPerThread) < 2) {
+                RearrangeArr<T>(arr, arr_sz, sorted, helper_memory);
+                return;
+            }
+
+            const auto src_idx = [sorted](size_t i) { return sorted[i].m_first; };
+            if constexpr (fits_entry) {
+                RadixGather(arr, arr_sz, src_idx, (T*)helper_memory, num_threads);
+            }
+            else {
+                auto scratch = GetRawMem<T>(arr_sz, usable_scratch);
+                RadixGather(arr, arr_sz, src_idx, scratch.get(), num_threads);
+            }
+        },
+        usable_mem1,
+        usable_mem2);
+}
+
+// The ways to sort within a memory budget, from the fastest to the one that needs the least memory.
+enum class RadixStrategy
+{
+    // the regular sort: LSD rounds between the elements (or their entries) and helper memory.
+    lsd,
+    // integral elements only: MSD rounds that permute the array in place, bucket by bucket (American flag sort).
+    in_place_msd,
+    // elements of any type: sort chunks that fit in the budget as RadixSort does, then merge them stably in place.
+    chunked_merge,
+    // elements of any type: as chunked_merge, with small chunks that are sorted with memory on the stack.
+    in_place_merge
+};
+
+struct RadixBudgetReport
+{
+    RadixStrategy   m_strategy = RadixStrategy::lsd;
+    // the helper memory that the strategy allocated dynamically, which is within the budget.
+    size_t          m_peak_bytes = 0;
+};
+
+// Buckets of the in-place MSD passes, one per digit of 8 bits.
+constexpr size_t RadixFlagBuckets = 256;
+
+// Permute arr in place into buckets by the digit of 8 bits at shift_bits of (value - min_val), and set ends[b] to the
+// end of bucket b in arr (American flag sort pass). Not stable, which makes no difference to integral values.
+template <class T>
+void RadixFlagPass(T *arr, size_t sz, T min_val, size_t shift_bits, size_t *ends)
+{
+    using unsigned_t = std::make_unsigned_t<T>;
+
+    const auto digit = [=](T val) {
+        return ((size_t)(unsigned_t)((unsigned_t)val - (unsigned_t)min_val) >> shift_bits) & (RadixFlagBuckets - 1);
+    };
+
+    size_t heads[RadixFlagBuckets] = {};
+    {
+        RADIX_STATS_PHASE(m_histogram, sz);
+        for (size_t i = 0; i < sz; ++i) {
+            ++heads[digit(arr[i])];
+        }
+    }
+    for (size_t b = 0, offset = 0; b < RadixFlagBuckets; ++b) {
+        offset += heads[b];
+        ends[b] = offset;
+        heads[b] = offset - heads[b];
+    }
+
+    // each value is swapped straight into the next free place of its bucket, until a value of the current
+    // bucket is found for the current place.
+    RADIX_STATS_PHASE(m_scatter, sz);
+    RADIX_STATS_ADD(m_rounds, 1);
+    for (size_t b = 0; b < RadixFlagBuckets; ++b) {
+        while (heads[b] < ends[b]) {
+            T val = arr[heads[b]];
+            for (size_t d = digit(val); d != b; d = digit(val)) {
+                std::swap(val, arr[heads[d]++]);
+            }
+            arr[heads[b]++] = val;
+        }
+    }
+}
+
+// Sort the values of arr, which are within [min_val, min_val + 2^(shift_bits + 8)), by their digit of 8 bits at
+// shift_bits, and then each bucket by the next digit, down to the lowest. Small buckets are sorted by std::sort.
+// Needs no helper memory, and a few KB of stack per digit.
+template <class T>
+void RadixInPlaceMSD(T *arr, size_t sz, T min_val, size_t shift_bits)
+{
+    if (sz <= RadixSegmentComparisonSortMax) {
+        std::sort(arr, arr + sz);
+        return;
+    }
+
+    size_t ends[RadixFlagBuckets];
+    RadixFlagPass(arr, sz, min_val, shift_bits, ends);
+
+    if (0 == shift_bits) return;
+
+    for (size_t b = 0, begin = 0; b < RadixFlagBuckets; begin = ends[b++]) {
+        RadixInPlaceMSD(arr + begin, ends[b] - begin, min_val, shift_bits - 8);
+    }
+}
+
+template <class T>
+void RadixIntegralInPlace(T *arr, size_t sz)
+{
+    using unsigned_t = std::make_unsigned_t<T>;
+
+    if ((sz < 2) || std::is_sorted(arr, arr + sz)) return;
+
+    const auto [min_it, max_it] = std::minmax_element(arr, arr + sz);
+    const T min_val = *min_it;
+    const size_t bits = RadixBitWidth((unsigned_t)*max_it - (unsigned_t)min_val);
+
+    RadixCheckCancelled();
+    RadixInPlaceMSD(arr, sz, min_val, ((bits - 1) / 8) * 8);
+}
+
+// Merge stably the sorted [first, middle) and [middle, last). A run that fits in buffer (raw memory for up to
+// buffer_sz elements) is moved there and merged back. Otherwise the runs are split, and their middle parts are swapped
+// by a rotation, into two smaller merges.
+template <class T, class LESS>
+void RadixMergeInPlace(T *first, T *middle, T *last, void *buffer, size_t buffer_sz, const LESS &less)
+{
+    const size_t len1 = middle - first;
+    const size_t len2 = last - middle;
+    if ((0 == len1) || (0 == len2) || !less(*middle, *(middle - 1))) return;
+
+    T *buf = (T*)buffer;
+    if (len1 <= buffer_sz) {
+        T *buf_end = std::uninitialized_move(first, middle, buf);
+        T *out = first;
+        T *it = buf;
+        while ((it != buf_end) && (middle != last)) {
+            *out++ = less(*middle, *it) ? std::move(*middle++) : std::move(*it++);
+        }
+        std::move(it, buf_end, out);
+        std::destroy(buf, buf_end);
+        return;
+    }
+    if (len2 <= buffer_sz) {
+        T *buf_end = std::uninitialized_move(middle, last, buf);
+        T *out = last;
+        T *it = buf_end;
+        while ((it != buf) && (middle != first)) {
+            *--out = less(*(it - 1), *(middle - 1)) ? std::move(*--middle) : std::move(*--it);
+        }
+        std::move_backward(buf, it, out);
+        std::destroy(buf, buf_end);
+        return;
+    }
+
+    T *cut1, *cut2;
+    if (len1 > len2) {
+        cut1 = first + len1 / 2;
+        cut2 = std::lower_bound(middle, last, *cut1, less);
+    }
+    else {
+        cut2 = middle + len2 / 2;
+        cut1 = std::upper_bound(first, middle, *cut2, less);
+    }
+    T *new_middle = std::rotate(cut1, middle, cut2);
+    RadixMergeInPlace(first, cut1, new_middle, buffer, buffer_sz, less);
+    RadixMergeInPlace(new_middle, cut2, last, buffer, buffer_sz, less);
+}
+
+// Sort chunks of chunk_sz elements with RadixSegmentKeys, with entries and locs of chunk_sz elements each,
+// and then merge them pairwise, with entries and locs as the buffer of the merges.
+template <class U, class T>
+void RadixChunkedMerge(
+        T                       *arr,
+        size_t                   sz,
+        U                       (T_to_unsigned)(const T&),
+        size_t                   chunk_sz,
+        RadixEntry<size_t>      *entries,
+        RadixEntry<size_t>      *locs)
+{
+    for (size_t begin = 0; begin < sz; begin += chunk_sz) {
+        RadixCheckCancelled();
+        RadixSegmentKeys(arr + begin, std::min(chunk_sz, sz - begin), T_to_unsigned, entries, locs);
+    }
+
+    // entries and locs are consecutive, unless they are on the stack (where they are too small to matter).
+    const bool consecutive = (entries + chunk_sz == locs);
+    const size_t buffer_bytes = (consecutive ? 2 : 1) * chunk_sz * sizeof(RadixEntry<size_t>);
+    const size_t buffer_sz = (alignof(T) <= alignof(RadixEntry<size_t>)) ? buffer_bytes / sizeof(T) : 0;
+    const auto less = [&T_to_unsigned](const T &lhs, const T &rhs) {
+        return T_to_unsigned(lhs) < T_to_unsigned(rhs);
+    };
 
-    RearrangeList<U>(lst, lst_sz, sorted.get());
+    RADIX_STATS_PHASE(m_merge, sz);
+    for (size_t run_sz = chunk_sz; run_sz < sz; run_sz *= 2) {
+        RadixCheckCancelled();
+        for (size_t begin = 0; begin + run_sz < sz; begin += 2 * run_sz) {
+            RadixMergeInPlace(
+                arr + begin, arr + begin + run_sz, arr + std::min(sz, begin + 2 * run_sz), entries, buffer_sz, less);
+        }
+    }
+}
+
+// Sorts running on this thread allocate no memory of their own, besides the helper memory that they are given, for the
+// lifetime of the scope: rounds whose counters would be dynamically allocated are split to rounds of narrower digits.
+class RadixStrictMemoryScope
+{
+public:
+    RadixStrictMemoryScope() : m_prev_strict(RadixCurStrictMemory())
+    {
+        RadixCurStrictMemory() = true;
+    }
+
+    ~RadixStrictMemoryScope() { RadixCurStrictMemory() = m_prev_strict; }
+
+    RadixStrictMemoryScope(const RadixStrictMemoryScope&) = delete;
+    RadixStrictMemoryScope& operator=(const RadixStrictMemoryScope&) = delete;
+
+private:
+    bool m_prev_strict;
+};
+
+// Sort with the fastest strategy whose helper memory fits in mem_budget bytes. If that memory cannot be allocated,
+// fall back to the in-place strategy. Nothing else is allocated (see RadixStrictMemoryScope), so the helper memory
+// is the peak.
+template <class T>
+RadixBudgetReport RadixIntegralBudget(T *arr, size_t sz, size_t mem_budget)
+{
+    const RadixStrictMemoryScope strict_memory;
+
+    if (sz * sizeof(T) <= mem_budget) {
+        try {
+            auto helper = GetMem<T>(sz);
+            RadixIntegral(arr, sz, helper.get());
+            return {RadixStrategy::lsd, sz * sizeof(T)};
+        }
+        catch (const std::bad_alloc&) {}
+    }
+
+    RadixIntegralInPlace(arr, sz);
+    return {RadixStrategy::in_place_msd, 0};
 }
 
+template <class U, class T>
+RadixBudgetReport RadixUserDefinedBudget(T *arr, size_t sz, U (T_to_unsigned)(const T&), size_t mem_budget)
+{
+    using radix_entry_t = RadixEntry<size_t>;
+
+    const RadixStrictMemoryScope strict_memory;
+
+    // both the regular sort and the sort of each chunk need two entries per element.
+    const size_t chunk_sz = mem_budget / (2 * sizeof(radix_entry_t));
+
+    if (chunk_sz > RadixSegmentKeysComparisonSortMax) {
+        try {
+            const size_t mem_sz = std::min(chunk_sz, sz);
+            auto mem = GetMem<radix_entry_t>(2 * mem_sz);
+            if (mem_sz == sz) {
+                RadixSegmentKeys(arr, sz, T_to_unsigned, mem.get(), mem.get() + sz);
+                return {RadixStrategy::lsd, 2 * sz * sizeof(radix_entry_t)};
+            }
+            RadixChunkedMerge(arr, sz, T_to_unsigned, chunk_sz, mem.get(), mem.get() + chunk_sz);
+            return {RadixStrategy::chunked_merge, 2 * chunk_sz * sizeof(radix_entry_t)};
+        }
+        catch (const std::bad_alloc&) {}
+    }
+
+    std::array<radix_entry_t, RadixSegmentKeysComparisonSortMax> entries, locs;
+    RadixChunkedMerge(arr, sz, T_to_unsigned, RadixSegmentKeysComparisonSortMax, entries.data(), locs.data());
+    return {RadixStrategy::in_place_merge, 0};
+}
+
+// Sets the cancel token of the sorts running on this thread, for the lifetime of the scope.
+class RadixCancelScope
+{
+public:
+    explicit RadixCancelScope(const RadixCancelToken *token) : m_prev_token(RadixCurCancelToken())
+    {
+        RadixCurCancelToken() = token;
+    }
+
+    ~RadixCancelScope() { RadixCurCancelToken() = m_prev_token; }
+
+    RadixCancelScope(const RadixCancelScope&) = delete;
+    RadixCancelScope& operator=(const RadixCancelScope&) = delete;
+
+private:
+    const RadixCancelToken *m_prev_token;
+};
+
+// Submit sort to executor, as a task that sets the result of the returned future to:
+// 0 for success, 1 if sort threw (memory allocation failure), 3 if it was cancelled, before it started or during it.
+// Return: The future, or an invalid future if the task could not be created or submitted.
+template <class EXECUTOR, class SORT>
+std::future<int> RadixAsyncImpl(EXECUTOR &executor, const RadixCancelToken *cancel_token, SORT sort) noexcept
+{
+    try {
+        auto promise = std::make_shared<std::promise<int>>();
+        std::future<int> result = promise->get_future();
+
+        executor(std::function<void()>([promise, cancel_token, sort]() {
+            int status = 0;
+            try {
+                RadixCancelScope scope(cancel_token);
+                RadixCheckCancelled();
+                sort();
+            }
+            catch (const RadixCancelled&) {
+                status = 3;
+            }
+            catch (...) {
+                status = 1;
+            }
+            promise->set_value(status);
+        }));
+
+        return result;
+    }
+    catch (...) {
+        return std::future<int>();
+    }
+}
+
+// A counting round usable in constant evaluation: no dynamic memory, no stats.
+template <class ELEM, size_t N, class GET_KEY>
+constexpr void RadixCountingConstexpr(
+        const std::array<ELEM, N>    &arr,
+        size_t                        round,
+        const GET_KEY                &get_key,
+        std::array<ELEM, N>          &out)
+{
+    size_t histogram[256] = {0};
+    const size_t shift_bits = (round - 1) * 8;
+
+    for (size_t i = 0; i < N; ++i) {
+        ++histogram[(get_key(arr[i]) >> shift_bits) & 0xFF];
+    }
+
+    for (size_t i = 0, offset = 0; i < 256; ++i) {
+        const size_t bucket_sz = histogram[i];
+        histogram[i] = offset;
+        offset += bucket_sz;
+    }
+
+    for (size_t i = 0; i < N; ++i) {
+        const size_t idx = (get_key(arr[i]) >> shift_bits) & 0xFF;
+        out[histogram[idx]] = arr[i];
+        ++histogram[idx];
+    }
+}
+
+// Sorts arr in rounds of key_sz bytes, using a second array on the stack instead of GetMem.
+template <class ELEM, size_t N, class GET_KEY>
+constexpr void RadixImplConstexpr(std::array<ELEM, N> &arr, size_t key_sz, const GET_KEY &get_key)
+{
+    std::array<ELEM, N> helper{};
+
+    for (size_t round = 1; round <= key_sz; round += 2) {
+        RadixCountingConstexpr(arr, round, get_key, helper);
+        if (round == key_sz) {
+            arr = helper;
+        }
+        else {
+            RadixCountingConstexpr(helper, round + 1, get_key, arr);
+        }
+    }
+}
+
+template <class T, size_t N>
+constexpr void RadixIntegralConstexpr(std::array<T, N> &arr)
+{
+    // flipping the sign bit orders signed values as unsigned ones, without partitioning the negative values.
+    using unsigned_t = std::make_unsigned_t<T>;
+    constexpr unsigned_t sign_bit = std::is_signed<T>::value ?
+        (unsigned_t)((unsigned_t)1 << (sizeof(T) * 8 - 1)) : 0;
+
+    RadixImplConstexpr(arr, sizeof(T), [](T val) { return (size_t)(unsigned_t)((unsigned_t)val ^ sign_bit); });
+}
+
+template <class T, size_t N, class U>
+constexpr std::array<T, N> RadixConsecutiveConstexpr(const std::array<T, N> &arr, U(*T_to_unsigned)(const T&))
+{
+    std::array<RadixEntry<size_t>, N> entries{};
+    for (size_t i = 0; i < N; ++i) {
+        entries[i].m_first = i;
+        entries[i].m_second = T_to_unsigned(arr[i]);
+    }
+
+    RadixImplConstexpr(entries, sizeof(U), [](const RadixEntry<size_t> &entry) { return entry.m_second; });
+
+    std::array<T, N> out{};
+    for (size_t i = 0; i < N; ++i) {
+        out[i] = arr[entries[i].m_first];
+    }
+    return out;
+}
+
+template <class T, class U>
+class RadixStreamImpl
+{
+public:
+    // U is void when T is integral and the elements themselves are the keys.
+    using key_func_t = std::conditional_t<std::is_void<U>::value, std::nullptr_t, U(*)(const T&)>;
+
+    RadixStreamImpl(key_func_t T_to_unsigned, size_t mem_budget) :
+        m_key_func(T_to_unsigned),
+        m_mem_budget(mem_budget),
+        m_file(nullptr, [](std::FILE *f){std::fclose(f);})
+    {}
+
+    bool IsMerging() const { return m_is_merging; }
+
+    void Push(const T *chunk, size_t sz)
+    {
+        if (0 == sz) return;
+
+        Run run;
+        run.m_buf.assign(chunk, chunk + sz);
+        SortRun(run.m_buf.data(), sz);
+
+        m_runs.push_back(std::move(run));
+        m_mem_used += sz * sizeof(T);
+
+        if (m_mem_used > m_mem_budget) {
+            try {
+                SpillRuns();
+            }
+            catch (...) {
+                // the runs that were spilled stay so, but the chunk is not taken (its run is the last to be spilled),
+                // so that the push can be retried.
+                m_runs.pop_back();
+                m_mem_used -= sz * sizeof(T);
+                throw;
+            }
+        }
+    }
+
+    size_t Pull(T *out, size_t max_out)
+    {
+        // a start that failed, on reading the runs back, is started again.
+        if (!m_is_merging || (m_tree.size() != m_runs.size())) {
+            StartMerge();
+        }
+        if (m_refill_run < m_runs.size()) {
+            Refill(m_runs[m_refill_run]);
+            AdjustTree(m_refill_run);
+            m_refill_run = SIZE_MAX;
+        }
+
+        size_t num_out = 0;
+        while ((num_out < max_out) && !m_runs.empty() && !m_runs[m_tree[0]].IsEmpty()) {
+            const size_t winner = m_tree[0];
+            Run &run = m_runs[winner];
+
+            out[num_out++] = run.m_buf[run.m_buf_pos++];
+            if ((run.m_buf_pos == run.m_buf.size()) && run.m_file_left) {
+                // if the run cannot be refilled, the elements pulled so far are returned, and the refill is left
+                // to the next pull, along with its exception if it fails again.
+                try {
+                    Refill(run);
+                }
+                catch (...) {
+                    m_refill_run = winner;
+                    return num_out;
+                }
+            }
+            AdjustTree(winner);
+        }
+
+        return num_out;
+    }
+
+private:
+    struct Run
+    {
+        // sorted elements currently in memory, consumed from m_buf_pos onwards.
+        std::vector<T>  m_buf;
+        size_t          m_buf_pos = 0;
+        // spilled elements not yet read back, starting at m_file_pos.
+        long            m_file_pos = 0;
+        size_t          m_file_left = 0;
+
+        bool IsEmpty() const { return (m_buf_pos == m_buf.size()) && (0 == m_file_left); }
+    };
+
+    void SortRun(T *arr, size_t sz)
+    {
+        if constexpr (std::is_void<U>::value) {
+            RadixIntegral(arr, sz);
+        }
+        else {
+            RadixConsecutive(
+                arr,
+                sz,
+                m_key_func,
+                [=](RadixEntry<size_t> *sorted, RadixEntry<size_t> *helper_memory){
+                    RearrangeArr<T>(arr, sz, sorted, helper_memory);
+                });
+        }
+    }
+
+    bool IsLess(const T &lhs, const T &rhs) const
+    {
+        if constexpr (std::is_void<U>::value) {
+            return lhs < rhs;
+        }
+        else {
+            return m_key_func(lhs) < m_key_func(rhs);
+        }
+    }
+
+    void SpillRuns()
+    {
+        if (!m_file) {
+            m_file.reset(std::tmpfile());
+            if (!m_file) throw std::runtime_error("radix stream: cannot create spill file");
+        }
+
+        for (Run &run : m_runs) {
+            if (run.m_buf.empty()) continue;
+
+            if (0 != std::fseek(m_file.get(), 0, SEEK_END)) {
+                throw std::runtime_error("radix stream: cannot seek spill file");
+            }
+            // a run that fails to be written stays in memory as it is, and is written anew by the next spill.
+            const long file_pos = std::ftell(m_file.get());
+            if ((file_pos < 0) ||
+                (std::fwrite(run.m_buf.data(), sizeof(T), run.m_buf.size(), m_file.get()) != run.m_buf.size())) {
+                throw std::runtime_error("radix stream: cannot write spill file");
+            }
+            run.m_file_pos = file_pos;
+            run.m_file_left = run.m_buf.size();
+            m_mem_used -= run.m_buf.size() * sizeof(T);
+            std::vector<T>().swap(run.m_buf);
+        }
+    }
+
+    void Refill(Run &run)
+    {
+        const size_t to_read = std::min(run.m_file_left, m_block_sz);
+
+        // read to a new buffer, so that if reading fails, run is left as it was, and can be refilled again.
+        std::vector<T> buf(to_read);
+        if ((0 != std::fseek(m_file.get(), run.m_file_pos, SEEK_SET)) ||
+            (std::fread(buf.data(), sizeof(T), to_read, m_file.get()) != to_read)) {
+            throw std::runtime_error("radix stream: cannot read spill file");
+        }
+        run.m_buf.swap(buf);
+        run.m_buf_pos = 0;
+        run.m_file_pos += (long)(to_read * sizeof(T));
+        run.m_file_left -= to_read;
+    }
+
+    // true when the head of run lhs should be emitted before the head of run rhs.
+    // m_runs.size() is a sentinel that beats every run, exhausted runs lose to every run,
+    // and ties go to the earlier run, which keeps the merge stable.
+    bool IsWinner(size_t lhs, size_t rhs) const
+    {
+        const size_t sentinel = m_runs.size();
+        if (sentinel == lhs) return true;
+        if (sentinel == rhs) return false;
+
+        const Run &l = m_runs[lhs];
+        const Run &r = m_runs[rhs];
+        if (l.IsEmpty()) return false;
+        if (r.IsEmpty()) return true;
+
+        const T &l_head = l.m_buf[l.m_buf_pos];
+        const T &r_head = r.m_buf[r.m_buf_pos];
+        if (IsLess(l_head, r_head)) return true;
+        if (IsLess(r_head, l_head)) return false;
+        return lhs < rhs;
+    }
+
+    // replay the matches on the path from leaf 'run' to the root of the loser tree.
+    void AdjustTree(size_t run)
+    {
+        size_t winner = run;
+        for (size_t node = (run + m_runs.size()) / 2; node > 0; node /= 2) {
+            if (IsWinner(m_tree[node], winner)) {
+                std::swap(m_tree[node], winner);
+            }
+        }
+        m_tree[0] = winner;
+    }
+
+    void StartMerge()
+    {
+        m_is_merging = true;
+        if (m_runs.empty()) return;
+
+        size_t num_spilled = 0;
+        for (const Run &run : m_runs) {
+            num_spilled += (0 != run.m_file_left);
+        }
+        if (num_spilled) {
+            const size_t mem_left = (m_mem_budget > m_mem_used) ? m_mem_budget - m_mem_used : 0;
+            m_block_sz = std::max(mem_left / (num_spilled * sizeof(T)), m_min_block_sz);
+            // runs that were refilled by an earlier, failed, start are not refilled again.
+            for (Run &run : m_runs) {
+                if (run.m_file_left && (run.m_buf_pos == run.m_buf.size())) Refill(run);
+            }
+        }
+
+        m_tree.assign(m_runs.size(), m_runs.size());
+        for (size_t run = m_runs.size(); run > 0; --run) {
+            AdjustTree(run - 1);
+        }
+    }
+
+    static constexpr size_t m_min_block_sz = 256;
+
+    key_func_t                                  m_key_func;
+    size_t                                      m_mem_budget;
+    size_t                                      m_mem_used = 0;
+    size_t                                      m_block_sz = m_min_block_sz;
+    bool                                        m_is_merging = false;
+    std::vector<Run>                            m_runs;
+    // m_tree[0]: the run holding the smallest head, other nodes: the loser of the match at that node.
+    std::vector<size_t>                         m_tree;
+    // the run whose refill failed, to be refilled by the next pull, SIZE_MAX if none.
+    size_t                                      m_refill_run = SIZE_MAX;
+    std::unique_ptr<std::FILE, void(*)(std::FILE*)> m_file;
+};
+
+template <class T, class U>
+class RadixCursorImpl
+{
+public:
+    // U is void when T is integral: the array itself is sorted, bucket by bucket.
+    // Otherwise, the array is left unchanged, and its entries are sorted.
+    static constexpr bool m_integral = std::is_void<U>::value;
+    using key_func_t = std::conditional_t<m_integral, std::nullptr_t, U(*)(const T&)>;
+    using arr_t = std::conditional_t<m_integral, T*, const T*>;
+    using radix_entry_t = RadixEntry<size_t>;
+
+    RadixCursorImpl(arr_t arr, size_t sz, key_func_t T_to_unsigned, void *usable_mem1, void *usable_mem2) :
+        m_arr(arr),
+        m_sz(sz),
+        m_key_func(T_to_unsigned),
+        m_usable_mem1(usable_mem1),
+        m_usable_mem2(usable_mem2)
+    {}
+
+    size_t Pull(T *out, size_t max_out)
+    {
+        return PullImpl(max_out, [=](size_t out_idx, size_t sorted_idx) {
+            if constexpr (m_integral) {
+                out[out_idx] = m_arr[sorted_idx];
+            }
+            else {
+                out[out_idx] = m_arr[m_bucket_entries[sorted_idx].m_first];
+            }
+        });
+    }
+
+    size_t PullIndexes(size_t *out, size_t max_out)
+    {
+        return PullImpl(max_out, [=](size_t out_idx, size_t sorted_idx) {
+            out[out_idx] = m_bucket_entries[sorted_idx].m_first;
+        });
+    }
+
+private:
+    // Partition by the highest digit of 8 bits of (key - min), and set the ends of the buckets.
+    void Start()
+    {
+        if constexpr (m_integral) {
+            using unsigned_t = std::make_unsigned_t<T>;
+
+            const auto [min_it, max_it] = std::minmax_element(m_arr, m_arr + m_sz);
+            const size_t bits = RadixBitWidth((unsigned_t)*max_it - (unsigned_t)*min_it);
+            RadixFlagPass(m_arr, m_sz, *min_it, (bits > 8) ? bits - 8 : 0, m_bucket_ends);
+        }
+        else {
+            m_entries1 = GetMem<radix_entry_t>(m_sz, m_usable_mem1);
+            m_entries2 = GetMem<radix_entry_t>(m_sz, m_usable_mem2);
+
+            size_t min_key = SIZE_MAX, max_key = 0;
+            {
+                RADIX_STATS_PHASE(m_key_extraction, m_sz);
+                for (size_t i = 0; i < m_sz; ++i) {
+                    const size_t key = m_key_func(m_arr[i]);
+                    m_entries1[i].m_first = i;
+                    m_entries1[i].m_second = key;
+                    min_key = std::min(min_key, key);
+                    max_key = std::max(max_key, key);
+                }
+            }
+
+            const size_t bits = RadixBitWidth(max_key - min_key);
+            const size_t shift_bits = (bits > 8) ? bits - 8 : 0;
+            size_t bucket_begins[RadixFlagBuckets + 1];
+            RadixPartitionImpl(
+                m_entries1.get(),
+                m_sz,
+                RadixFlagBuckets,
+                [=](const radix_entry_t &entry) {
+                    return ((entry.m_second - min_key) >> shift_bits) & (RadixFlagBuckets - 1);
+                },
+                m_entries2.get(),
+                bucket_begins,
+                1,
+                false);
+            std::copy(bucket_begins + 1, bucket_begins + RadixFlagBuckets + 1, m_bucket_ends);
+        }
+
+        m_started = true;
+    }
+
+    // Sort the current bucket: the array in it, or its entries, which are in m_entries2 after Start(),
+    // with m_entries1 as helper memory.
+    void SortBucket()
+    {
+        const size_t begin = BucketBegin();
+        const size_t sz = m_bucket_ends[m_bucket] - begin;
+
+        if constexpr (m_integral) {
+            if (!m_helper) {
+                size_t max_bucket_sz = 0;
+                for (size_t b = 0, bucket_begin = 0; b < RadixFlagBuckets; bucket_begin = m_bucket_ends[b++]) {
+                    max_bucket_sz = std::max(max_bucket_sz, m_bucket_ends[b] - bucket_begin);
+                }
+                m_helper = GetMem<T>(max_bucket_sz, m_usable_mem1);
+            }
+            RadixIntegral(m_arr + begin, sz, m_helper.get());
+            m_bucket_entries = nullptr;
+        }
+        else {
+            const auto copy_entry = [](radix_entry_t &entry, const radix_entry_t *it, size_t) { entry = *it; };
+            const radix_entry_t *sorted = RadixImpl<U>(
+                m_entries2.get() + begin, sz, m_entries1.get() + begin, m_entries2.get() + begin, copy_entry).first;
+            // indexed by the place in the whole sorted order.
+            m_bucket_entries = sorted - begin;
+        }
+
+        m_bucket_sorted = true;
+    }
+
+    size_t BucketBegin() const { return m_bucket ? m_bucket_ends[m_bucket - 1] : 0; }
+
+    // output(out_idx, sorted_idx) outputs the element at sorted_idx of the sorted order.
+    template <class OUTPUT>
+    size_t PullImpl(size_t max_out, const OUTPUT &output)
+    {
+        if (!m_started && m_sz) {
+            Start();
+        }
+
+        size_t num_out = 0;
+        while ((num_out < max_out) && (m_pos < m_sz)) {
+            while (m_pos == m_bucket_ends[m_bucket]) {
+                ++m_bucket;
+                m_bucket_sorted = false;
+            }
+            if (!m_bucket_sorted) {
+                // if the elements pulled so far cannot be returned with the exception, return them,
+                // and leave the exception to the next pull, which will sort this bucket again.
+                try {
+                    SortBucket();
+                }
+                catch (...) {
+                    if (0 == num_out) throw;
+                    return num_out;
+                }
+            }
+
+            const size_t num_bucket_out = std::min(max_out - num_out, m_bucket_ends[m_bucket] - m_pos);
+            for (size_t i = 0; i < num_bucket_out; ++i) {
+                output(num_out + i, m_pos + i);
+            }
+            num_out += num_bucket_out;
+            m_pos += num_bucket_out;
+        }
+
+        return num_out;
+    }
+
+    using entries_ptr = decltype(GetMem<radix_entry_t>(0));
+    using helper_ptr = decltype(GetMem<std::conditional_t<m_integral, T, radix_entry_t>>(0));
+
+    arr_t                   m_arr;
+    size_t                  m_sz;
+    key_func_t              m_key_func;
+    void                   *m_usable_mem1;
+    void                   *m_usable_mem2;
+    bool                    m_started = false;
+    // the end of each bucket in the sorted order.
+    size_t                  m_bucket_ends[RadixFlagBuckets] = {};
+    size_t                  m_bucket = 0;
+    bool                    m_bucket_sorted = false;
+    // the next place in the sorted order to pull.
+    size_t                  m_pos = 0;
+    // the sorted entries of the current bucket, indexed by the place in the whole sorted order.
+    const radix_entry_t    *m_bucket_entries = nullptr;
+    entries_ptr             m_entries1{nullptr, [](radix_entry_t*){}};
+    entries_ptr             m_entries2{nullptr, [](radix_entry_t*){}};
+    helper_ptr              m_helper{nullptr, [](auto*){}};
+};
+
 #endif // RADIX_SORT_INTERNAL
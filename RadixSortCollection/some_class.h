@@ -0,0 +1,126 @@
+#ifndef RADIX_SORT_SOME_CLASS_H
+#define RADIX_SORT_SOME_CLASS_H
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <cctype>
+#include <cstdint>
+#include <type_traits>
+
+// user defined type, sorted by the tests and by the benchmark.
+class SomeClass
+{
+   friend std::ostream &operator<<(std::ostream &o, const SomeClass &sc);
+public:
+
+   SomeClass(size_t id = 0)
+   {
+       // random values for checking the sort
+       char name[4] = {0};
+       for(size_t i = 0; i < (sizeof(name) - 1); ++i) {
+           name[i] = 'a' + (rand() % (('z' - 'a') + 1));
+           if (rand() % 2) {
+               name[i] = toupper(name[i]);
+           }
+       }
+
+       m_num = id;
+       m_str = name;
+   }
+
+   SomeClass& operator=(SomeClass &&rhs)
+   {
+       m_num = rhs.m_num;
+       m_str = std::move(rhs.m_str);
+       return *this;
+   }
+
+   SomeClass(SomeClass &&rhs)
+   {
+       m_num = rhs.m_num;
+       m_str = std::move(rhs.m_str);
+   }
+
+   SomeClass(const SomeClass &rhs)
+   {
+       // added this method for ensuring that no
+       // objects are created during radix sort
+
+      ++ctr_cctor;
+
+       m_num = rhs.m_num;
+       m_str = rhs.m_str;
+   }
+
+   SomeClass& operator=(const SomeClass &rhs)
+   {
+       // aded this method for ensuring that no
+       // objects are assigned to during radix sort
+
+       ++ctr_assign;
+
+       if (this == &rhs)
+           return *this;
+
+       m_num = rhs.m_num;
+       m_str = rhs.m_str;
+
+       return (*this);
+   }
+
+   static auto getKey(const SomeClass &f)
+   {
+       return f.m_num;
+      //return (unsigned char)f.m_str.at(0);
+   }
+
+   static constexpr auto keySize() {
+        return sizeof(std::result_of<decltype(&getKey)(const SomeClass&)>::type);
+   }
+
+   bool operator!=(const SomeClass &rhs) const
+   {
+       return SomeClass::getKey(*this) != SomeClass::getKey(rhs);
+   }
+
+   bool operator<(const SomeClass &rhs) const
+   {
+      return (getKey(*this) < getKey(rhs)) ;
+   }
+
+   static void InitTestObjectCreationsAndAssignments()
+   {
+      ctr_assign = 0;
+      ctr_cctor = 0;
+   }
+
+   static void TestObjectCreationsAndAssignments()
+   {
+      if (ctr_cctor != 0) {
+          std::cout << "Error: T objects were created during sort:" << ctr_cctor << std::endl;
+      }
+      if (ctr_assign != 0) {
+          std::cout << "Error: T objects were assigned during sort." << ctr_assign << std::endl;
+      }
+   }
+
+private:
+   uint64_t    m_num;
+   std::string m_str;
+
+   // for ensuring that no objects are created nor
+   // assigned to during radix sort.
+   static size_t ctr_cctor;
+   static size_t ctr_assign;
+};
+inline size_t SomeClass::ctr_assign(0);
+inline size_t SomeClass::ctr_cctor(0);
+
+inline std::ostream &operator<<(std::ostream &o, const SomeClass &sc)
+{
+   o << "[" << sc.m_num << ", " << sc.m_str << "], ";
+   return o;
+}
+
+#endif // RADIX_SORT_SOME_CLASS_H
@@ -2,125 +2,50 @@
 #include <vector>
 #include <algorithm>
 #include <memory>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <cstdlib>
+#include <new>
 
 using namespace std;
 
-#include "radix_sort_api.h"
+// Bytes allocated with operator new by this thread while counting, for checking that a sort keeps within its budget.
+static thread_local bool count_heap = false;
+static thread_local size_t heap_bytes = 0;
 
-class SomeClass
+void *operator new(size_t sz)
 {
-   friend ostream &operator<<(ostream &o, const SomeClass &sc);
-public:
-
-   SomeClass(size_t id = 0)
-   {
-       // random values for checking the sort
-       char name[4] = {0};
-       for(size_t i = 0; i < (sizeof(name) - 1); ++i) {
-           name[i] = 'a' + (rand() % (('z' - 'a') + 1));
-           if (rand() % 2) {
-               name[i] = toupper(name[i]);
-           }
-       }
-
-       m_num = id;
-       m_str = name;
-   }
-
-   SomeClass& operator=(SomeClass &&rhs)
-   {
-       m_num = rhs.m_num;
-       m_str = std::move(rhs.m_str);
-       return *this;
-   }
-
-   SomeClass(SomeClass &&rhs)
-   {
-       m_num = rhs.m_num;
-       m_str = std::move(rhs.m_str);
-   }
-
-   SomeClass(const SomeClass &rhs)
-   {
-       // added this method for ensuring that no
-       // objects are created during radix sort
-
-      ++ctr_cctor;
-
-       m_num = rhs.m_num;
-       m_str = rhs.m_str;
-   }
-
-   SomeClass& operator=(const SomeClass &rhs)
-   {
-       // aded this method for ensuring that no
-       // objects are assigned to during radix sort
-
-       ++ctr_assign;
-
-       if (this == &rhs)
-           return *this;
-
-       m_num = rhs.m_num;
-       m_str = rhs.m_str;
-
-       return (*this);
-   }
-
-   static auto getKey(const SomeClass &f)
-   {
-       return f.m_num;
-      //return (unsigned char)f.m_str.at(0);
-   }
-
-   static constexpr auto keySize() {
-        return sizeof(std::result_of<decltype(&getKey)(const SomeClass&)>::type);
-   }
-
-   bool operator!=(const SomeClass &rhs) const
-   {
-       return SomeClass::getKey(*this) != SomeClass::getKey(rhs);
-   }
-
-   bool operator<(const SomeClass &rhs) const
-   {
-      return (getKey(*this) < getKey(rhs)) ;
-   }
-
-   static void InitTestObjectCreationsAndAssignments()
-   {
-      ctr_assign = 0;
-      ctr_cctor = 0;
-   }
-
-   static void TestObjectCreationsAndAssignments()
-   {
-      if (ctr_cctor != 0) {
-          cout << "Error: T objects were created during sort:" << ctr_cctor << endl;
-      }
-      if (ctr_assign != 0) {
-          cout << "Error: T objects were assigned during sort." << ctr_assign << endl;
-      }
-   }
-
-private:
-   uint64_t    m_num;
-   string      m_str;
-
-   // for ensuring that no objects are created nor
-   // assigned to during radix sort.
-   static size_t ctr_cctor;
-   static size_t ctr_assign;
-};
-size_t SomeClass::ctr_assign(0);
-size_t SomeClass::ctr_cctor(0);
-
-ostream &operator<<(ostream &o, const SomeClass &sc)
+   if (count_heap) heap_bytes += sz;
+   if (void *mem = malloc(sz ? sz : 1)) return mem;
+   throw std::bad_alloc();
+}
+// not inlined, or GCC warns of free() of memory that it sees as allocated by operator new.
+#if defined(__GNUC__)
+#define TEST_NOINLINE __attribute__((noinline))
+#else
+#define TEST_NOINLINE
+#endif
+TEST_NOINLINE void operator delete(void *mem) noexcept { free(mem); }
+TEST_NOINLINE void operator delete(void *mem, size_t) noexcept { free(mem); }
+
+template <class SORT>
+int CountHeap(const SORT &sort)
 {
-   o << "[" << sc.m_num << ", " << sc.m_str << "], ";
-   return o;
+   heap_bytes = 0;
+   count_heap = true;
+   const int status = sort();
+   count_heap = false;
+   return status;
 }
 
+// stats are on, unless the build asks for them off (-DRADIX_TEST_WITHOUT_STATS), to test that they compile away.
+#if !defined(RADIX_SORT_STATS) && !defined(RADIX_TEST_WITHOUT_STATS)
+#define RADIX_SORT_STATS
+#endif
+#include "radix_sort_api.h"
+#include "some_class.h"
+
 template <class IT>
 void Print(IT it, size_t sz)
 {
@@ -296,8 +221,8 @@ void TestArrUserDefinedType(size_t sz)
    auto arr = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
    auto arr_ok = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
 
-   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t i) {
-       *elem1 = *elem2 = SomeClass(i);
+   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t) {
+       *elem1 = *elem2 = SomeClass(rand());
    };
    const auto radix_call = [arr, sz]() {return RadixSort(arr.get(), sz, SomeClass::getKey);};
    const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
@@ -323,8 +248,8 @@ void TestArrUserDefinedTypeAllocHere(size_t sz)
        return;
    }
 
-   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t i) {
-       *elem1 = *elem2 = SomeClass(i);
+   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t) {
+       *elem1 = *elem2 = SomeClass(rand());
    };
    const auto radix_call = [arr, sz, mem1, mem2]() {
        return RadixSort(arr.get(), sz, SomeClass::getKey, mem1, mem2);
@@ -346,8 +271,8 @@ void TestArrUserDefinedTypeAllocHerePartially(size_t sz)
    auto arr_ok = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
    auto mem1 = std::shared_ptr<size_t[]>(new size_t[sz * 2]);
 
-   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t i) {
-       *elem1 = *elem2 = SomeClass(i);
+   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t) {
+       *elem1 = *elem2 = SomeClass(rand());
    };
    const auto radix_call = [arr, sz, mem1]() {
        return RadixSort(arr.get(), sz, SomeClass::getKey, mem1.get());};
@@ -365,8 +290,8 @@ void TestArrUserDefinedTypeIndexesOnly(size_t sz)
    auto arr_ok = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
    auto idxs = std::shared_ptr<size_t[]>(new size_t[sz]);
 
-   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t i) {
-       *elem1 = *elem2 = SomeClass(i);
+   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t) {
+       *elem1 = *elem2 = SomeClass(rand());
    };
    const auto radix_call = [arr, sz, idxs]() {
        return RadixSortIndexesOnly(arr.get(), sz, SomeClass::getKey, idxs.get());};
@@ -386,8 +311,8 @@ void TestArrUserDefinedTypeIndexesOnlyAllocHere(size_t sz)
    auto mem1 = std::shared_ptr<size_t[]>(new size_t[sz * 2]);
    auto mem2 = std::shared_ptr<size_t[]>(new size_t[sz * 2]);
 
-   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t i) {
-       *elem1 = *elem2 = SomeClass(i);
+   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t) {
+       *elem1 = *elem2 = SomeClass(rand());
    };
    const auto radix_call = [arr, sz, idxs, mem1, mem2]() {
        return RadixSortIndexesOnly(arr.get(), sz, SomeClass::getKey, idxs.get(), mem1.get(), mem2.get());};
@@ -458,8 +383,8 @@ void TestListUserDefinedType(size_t sz)
    list<SomeClass> lst, lst_ok;
 
    using it_t = list<SomeClass>::iterator;
-   const auto create_entry = [&lst, &lst_ok](it_t, it_t, size_t i) {
-       SomeClass f(i);
+   const auto create_entry = [&lst, &lst_ok](it_t, it_t, size_t) {
+       SomeClass f(rand());
        try {
            lst.push_back(f);
            lst_ok.push_back(f);
@@ -485,8 +410,8 @@ void TestListUserDefinedTypeAllocateHere(size_t sz)
    auto mem2 = shared_ptr<char[]>(new char[mem_sz]);
 
    using it_t = list<SomeClass>::iterator;
-   const auto create_entry = [&lst, &lst_ok](it_t, it_t, size_t i) {
-       SomeClass f(i);
+   const auto create_entry = [&lst, &lst_ok](it_t, it_t, size_t) {
+       SomeClass f(rand());
        try {
            lst_ok.push_back(f);
            lst.push_back(f);
@@ -527,8 +452,8 @@ void TestVectorUserDefinedType(size_t sz)
    vector<SomeClass> vec_ok;
 
    using it_t = vector<SomeClass>::iterator;
-   const auto create_entry = [&vec, &vec_ok](it_t, it_t, size_t i) {
-       SomeClass f(i);
+   const auto create_entry = [&vec, &vec_ok](it_t, it_t, size_t) {
+       SomeClass f(rand());
        try {
            vec.push_back(f);
            vec_ok.push_back(f);
@@ -544,6 +469,844 @@ void TestVectorUserDefinedType(size_t sz)
    TestImpl(vec.begin(), vec_ok.begin(), sz, create_entry, radix_call, std_call, check_call);
 }
 
+struct StreamRecord
+{
+   uint32_t m_key;
+   uint32_t m_seq;
+
+   static uint32_t getKey(const StreamRecord &r) { return r.m_key; }
+
+   // compares the original order too, for checking that the sort is stable
+   bool operator!=(const StreamRecord &rhs) const { return (m_key != rhs.m_key) || (m_seq != rhs.m_seq); }
+   bool operator<(const StreamRecord &rhs) const { return m_key < rhs.m_key; }
+};
+
+template <class T>
+void TestStreamIntegralType(size_t max_val, size_t sz, size_t chunk_sz, size_t mem_budget)
+{
+   cout << "\nStream sorting " << sz << " " << typeid(T).name() << " in chunks of " << chunk_sz
+        << ", memory budget " << mem_budget << " bytes\n";
+
+   auto arr = std::shared_ptr<T[]>(new T[sz]);
+   auto arr_ok = std::shared_ptr<T[]>(new T[sz]);
+
+   const auto create_entry = [max_val](T *elem1, T *elem2, size_t) {
+       *elem1 = *elem2 = GetRandIntegral<T>(max_val, false);
+   };
+   const auto radix_call = [arr, sz, chunk_sz, mem_budget]() {
+       RadixStreamSorter<T> sorter(mem_budget);
+       for (size_t pushed = 0; pushed < sz; pushed += chunk_sz) {
+           if (sorter.Push(arr.get() + pushed, std::min(chunk_sz, sz - pushed))) return 1;
+       }
+
+       // pull in odd sized pieces, to cross the spilled blocks at arbitrary places
+       size_t pulled = 0, num_out = 0;
+       do {
+           if (sorter.Pull(arr.get() + pulled, std::min<size_t>(777, sz - pulled), num_out)) return 1;
+           pulled += num_out;
+       } while (num_out);
+
+       return (pulled == sz) ? 0 : 1;
+   };
+   const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() { check(arr.get(), arr_ok.get(), sz); };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+
+void TestStreamUserDefinedType(size_t sz, size_t chunk_sz, size_t mem_budget)
+{
+   cout << "\nStream sorting " << sz << " records in chunks of " << chunk_sz
+        << ", memory budget " << mem_budget << " bytes\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+
+   const auto create_entry = [](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)(rand() % 1000), (uint32_t)i};
+   };
+   const auto radix_call = [arr, sz, chunk_sz, mem_budget]() {
+       RadixStreamSorter<StreamRecord, uint32_t> sorter(StreamRecord::getKey, mem_budget);
+       for (size_t pushed = 0; pushed < sz; pushed += chunk_sz) {
+           if (sorter.Push(arr.get() + pushed, std::min(chunk_sz, sz - pushed))) return 1;
+       }
+
+       size_t num_out = 0;
+       if (sorter.Pull(arr.get(), sz, num_out) || (num_out != sz)) return 1;
+       return sorter.Push(arr.get(), 1) == 2 ? 0 : 1;
+   };
+   const auto std_call = [arr_ok, sz](){std::stable_sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() { check(arr.get(), arr_ok.get(), sz); };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+enum class Presorted { sorted, reversed, reversed_with_dups, few_runs };
+
+static const char *PresortedName(Presorted presorted)
+{
+   switch (presorted) {
+       case Presorted::sorted:    return "already sorted";
+       case Presorted::reversed:  return "reverse sorted";
+       case Presorted::reversed_with_dups: return "reverse sorted with repeating values";
+       case Presorted::few_runs:  return "few sorted runs";
+   }
+   return "";
+}
+
+// values for element i of a presorted array of sz elements.
+static size_t GetPresortedVal(Presorted presorted, size_t i, size_t sz)
+{
+   switch (presorted) {
+       case Presorted::sorted:    return i / 3;
+       case Presorted::reversed:  return sz - i;
+       case Presorted::reversed_with_dups: return (sz - i) / 3;
+       case Presorted::few_runs:  return (i % (sz / 3 + 1)) / 2;
+   }
+   return 0;
+}
+
+template <class T>
+void TestArrIntegralTypePresorted(size_t sz, Presorted presorted)
+{
+   cout << "\nSorting array of " << sz << " " << typeid(T).name() << ", " << PresortedName(presorted) << "\n";
+
+   auto arr = std::shared_ptr<T[]>(new T[sz]);
+   auto arr_ok = std::shared_ptr<T[]>(new T[sz]);
+
+   const auto create_entry = [presorted, sz](T *elem1, T *elem2, size_t i) {
+       *elem1 = *elem2 = (T)GetPresortedVal(presorted, i, sz) - (T)(sz / 6);
+   };
+   const auto radix_call = [arr, sz]() {return RadixSort(arr.get(), sz);};
+   const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() { check(arr.get(), arr_ok.get(), sz); };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestArrUserDefinedTypePresorted(size_t sz, Presorted presorted)
+{
+   cout << "\nSorting array of " << sz << " records, " << PresortedName(presorted) << ", checking stability\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+
+   const auto create_entry = [presorted, sz](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)GetPresortedVal(presorted, i, sz), (uint32_t)i};
+   };
+   const auto radix_call = [arr, sz]() {return RadixSort(arr.get(), sz, StreamRecord::getKey);};
+   const auto std_call = [arr_ok, sz](){std::stable_sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() { check(arr.get(), arr_ok.get(), sz); };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+struct OpcodeEntry
+{
+   unsigned char   m_opcode = 0;
+   const char     *m_name = "";
+
+   static constexpr unsigned char getKey(const OpcodeEntry &e) { return e.m_opcode; }
+};
+
+// std::array's operator== is not constexpr in C++17
+template <class T, size_t N>
+constexpr bool ArrEqual(const std::array<T, N> &lhs, const std::array<T, N> &rhs)
+{
+   for (size_t i = 0; i < N; ++i) {
+       if (lhs[i] != rhs[i]) return false;
+   }
+   return true;
+}
+
+void TestConstexprSort()
+{
+   cout << "\nSorting std::array at compile time\n";
+
+   constexpr auto ints = RadixSorted(std::array<int, 8>{7, -3, 0, INT_MIN, 42, -3, INT_MAX, 1});
+   static_assert(ArrEqual(ints, std::array<int, 8>{INT_MIN, -3, -3, 0, 1, 7, 42, INT_MAX}), "constexpr integral sort");
+
+   constexpr auto chars = RadixSorted(std::array<signed char, 5>{5, -1, 127, -128, 0});
+   static_assert(ArrEqual(chars, std::array<signed char, 5>{-128, -1, 0, 5, 127}), "constexpr odd rounds sort");
+
+   constexpr auto opcodes = RadixSorted(std::array<OpcodeEntry, 4>{{
+       {0x90, "nop"}, {0x01, "add"}, {0xC3, "ret"}, {0x01, "add2"}}}, OpcodeEntry::getKey);
+   static_assert((opcodes[0].m_opcode == 0x01) && (opcodes[0].m_name[3] == '\0') &&
+                 (opcodes[1].m_name[3] == '2') && (opcodes[3].m_opcode == 0xC3), "constexpr stable keyed sort");
+
+   // the same functions at run time
+   std::array<int64_t, 1000> arr{};
+   for (auto &v : arr) v = GetRandIntegral<int64_t>(INT64_MAX, false);
+   std::array<int64_t, 1000> arr_ok = arr;
+   std::sort(arr_ok.begin(), arr_ok.end());
+   arr = RadixSorted(arr);
+   check(arr.begin(), arr_ok.begin(), arr.size());
+   cout << endl;
+}
+
+void TestArrUserDefinedTypeIndexesAndRanks32(size_t sz, size_t num_keys)
+{
+   cout << "\nSorting array of " << sz << " records by " << num_keys << " possible keys, 32 bit indexes and ranks\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto idxs = std::shared_ptr<uint32_t[]>(new uint32_t[sz]);
+   auto ranks = std::shared_ptr<uint32_t[]>(new uint32_t[sz]);
+
+   const auto create_entry = [num_keys](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)(rand() % num_keys), (uint32_t)i};
+   };
+   const auto radix_call = [arr, sz, idxs, ranks]() {
+       uint8_t small_idxs[1];
+       if (RadixSortIndexesOnly(arr.get(), sz, StreamRecord::getKey, small_idxs) != 2) {
+           cout << "Error: Indexes of 8 bits accepted for " << sz << " elements\n";
+       }
+       return RadixSortIndexesOnly(arr.get(), sz, StreamRecord::getKey, idxs.get()) |
+              RadixSortRanksOnly(arr.get(), sz, StreamRecord::getKey, ranks.get());
+   };
+   const auto std_call = [arr_ok, sz](){std::stable_sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, idxs, ranks, sz]() {
+       for (size_t i = 0; i < sz; ++i) {
+           if (arr[idxs[i]] != arr_ok[i]) {
+               cout << "Error: Radix did not work (compared to std).\n";
+               return;
+           }
+           if (idxs[ranks[i]] != i) {
+               cout << "Error: Ranks are not the inverse of the indexes.\n";
+               return;
+           }
+       }
+       cout << "radix ok   ";
+   };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestGroupBy(size_t sz, size_t num_keys)
+{
+   cout << "\nGrouping array of " << sz << " records by " << num_keys << " possible keys\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto idxs = std::shared_ptr<size_t[]>(new size_t[sz]);
+   auto begins = std::shared_ptr<size_t[]>(new size_t[sz]);
+   auto sizes = std::shared_ptr<size_t[]>(new size_t[sz]);
+   auto keys = std::shared_ptr<uint32_t[]>(new uint32_t[sz]);
+   size_t num_groups = 0;
+
+   const auto create_entry = [num_keys](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)(rand() % num_keys) * 1000, (uint32_t)i};
+   };
+   const auto radix_call = [=, &num_groups]() {
+       return RadixGroupBy(arr.get(), sz, StreamRecord::getKey, idxs.get(),
+                           begins.get(), sizes.get(), keys.get(), num_groups);
+   };
+   const auto std_call = [arr_ok, sz](){std::stable_sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [=, &num_groups]() {
+       size_t expected_groups = 0;
+       for (size_t i = 0; i < sz; ++i) {
+           if (i && (arr_ok[i].m_key == arr_ok[i - 1].m_key)) continue;
+
+           size_t end = i;
+           while ((end < sz) && (arr_ok[end].m_key == arr_ok[i].m_key)) ++end;
+           if ((begins[expected_groups] != i) || (sizes[expected_groups] != end - i) ||
+               (keys[expected_groups] != arr_ok[i].m_key)) {
+               cout << "Error: Wrong group " << expected_groups << endl;
+               return;
+           }
+           ++expected_groups;
+       }
+       if (num_groups != expected_groups) {
+           cout << "Error: Wrong number of groups: " << num_groups << " instead of " << expected_groups << endl;
+           return;
+       }
+       check(arr.get(), arr_ok.get(), idxs.get(), sz);
+   };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+template <class T>
+void TestUnique(size_t max_val, size_t sz)
+{
+   cout << "\nSorting array of " << sz << " " << typeid(T).name() << " up to " << max_val << ", unique\n";
+
+   auto arr = std::shared_ptr<T[]>(new T[sz]);
+   auto arr_ok = std::shared_ptr<T[]>(new T[sz]);
+   size_t num_unique = 0, num_unique_ok = 0;
+
+   const auto create_entry = [max_val](T *elem1, T *elem2, size_t) {
+       *elem1 = *elem2 = GetRandIntegral<T>(max_val, false);
+   };
+   const auto radix_call = [arr, sz, &num_unique]() {return RadixUnique(arr.get(), sz, num_unique);};
+   const auto std_call = [arr_ok, sz, &num_unique_ok](){
+       std::sort(arr_ok.get(), arr_ok.get() + sz);
+       num_unique_ok = std::unique(arr_ok.get(), arr_ok.get() + sz) - arr_ok.get();
+   };
+   const auto check_call = [arr, arr_ok, &num_unique, &num_unique_ok]() {
+       if (num_unique != num_unique_ok) {
+           cout << "Error: " << num_unique << " unique values instead of " << num_unique_ok << endl;
+           return;
+       }
+       check(arr.get(), arr_ok.get(), num_unique);
+   };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+// segments of random sizes up to max_segment_sz, one after the other, covering [0, sz).
+std::vector<size_t> CreateSegmentBegins(size_t sz, size_t max_segment_sz)
+{
+   std::vector<size_t> begins{0};
+   while (begins.back() < sz) {
+      begins.push_back(std::min(sz, begins.back() + rand() % (max_segment_sz + 1)));
+   }
+   return begins;
+}
+
+// checks the scenario where each segment is sorted on its own.
+template<class T>
+static void checkSegments(const T *arr, const T *arr_ok, const std::vector<size_t> &begins)
+{
+   for (size_t s = 0; s + 1 < begins.size(); ++s) {
+       for (size_t i = begins[s]; i < begins[s + 1]; ++i) {
+           if (arr[i] != arr_ok[i]) {
+               cout << "Error: Radix did not work (compared to std) in segment " << s << ".\n";
+               return;
+           }
+           if ((i > begins[s]) && (arr[i] < arr[i - 1])) {
+               cout << "Error: Radix did not work (bigger element before smaller element) in segment " << s << ".\n";
+               return;
+           }
+       }
+   }
+
+   cout << "radix ok   ";
+}
+
+template <class T>
+void TestSegmentsIntegralType(size_t max_val, size_t sz, size_t max_segment_sz, size_t num_threads)
+{
+   cout << "\nSorting segments of up to " << max_segment_sz << " " << typeid(T).name() << " in array of " << sz
+        << ", " << num_threads << " threads\n";
+
+   auto arr = std::shared_ptr<T[]>(new T[sz]);
+   auto arr_ok = std::shared_ptr<T[]>(new T[sz]);
+   const std::vector<size_t> begins = CreateSegmentBegins(sz, max_segment_sz);
+   const size_t num_segments = begins.size() - 1;
+
+   const auto create_entry = [max_val](T *elem1, T *elem2, size_t) {
+       *elem1 = *elem2 = GetRandIntegral<T>(max_val, false);
+   };
+   const auto radix_call = [&]() {
+       const size_t decreasing[] = {0, 2, 1};
+       if (RadixSortSegments(arr.get(), decreasing, 2) != 2) {
+           cout << "Error: Decreasing segment begins accepted\n";
+       }
+       return RadixSortSegments(arr.get(), begins.data(), num_segments, num_threads);
+   };
+   const auto std_call = [&]() {
+       for (size_t s = 0; s < num_segments; ++s) {
+           std::sort(arr_ok.get() + begins[s], arr_ok.get() + begins[s + 1]);
+       }
+   };
+   const auto check_call = [&](){checkSegments(arr.get(), arr_ok.get(), begins);};
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestSegmentsUserDefinedType(size_t sz, size_t max_segment_sz, size_t num_threads)
+{
+   cout << "\nSorting segments of up to " << max_segment_sz << " records in array of " << sz
+        << ", " << num_threads << " threads\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   const std::vector<size_t> begins = CreateSegmentBegins(sz, max_segment_sz);
+   const size_t num_segments = begins.size() - 1;
+
+   const auto create_entry = [](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)(rand() % 100), (uint32_t)i};
+   };
+   const auto radix_call = [&]() {
+       return RadixSortSegments(arr.get(), begins.data(), num_segments, StreamRecord::getKey, num_threads);
+   };
+   const auto std_call = [&]() {
+       for (size_t s = 0; s < num_segments; ++s) {
+           std::stable_sort(arr_ok.get() + begins[s], arr_ok.get() + begins[s + 1]);
+       }
+   };
+   const auto check_call = [&](){checkSegments(arr.get(), arr_ok.get(), begins);};
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+static const char *StrategyName(RadixStrategy strategy)
+{
+   switch (strategy) {
+      case RadixStrategy::lsd:            return "lsd";
+      case RadixStrategy::in_place_msd:   return "in_place_msd";
+      case RadixStrategy::chunked_merge:  return "chunked_merge";
+      case RadixStrategy::in_place_merge: return "in_place_merge";
+   }
+   return "";
+}
+
+static void checkReport(const RadixBudgetReport &report, size_t mem_budget, RadixStrategy expected)
+{
+   if ((report.m_strategy != expected) || (report.m_peak_bytes > mem_budget)) {
+       cout << "Error: Strategy " << StrategyName(report.m_strategy) << " with " << report.m_peak_bytes
+            << " bytes, instead of " << StrategyName(expected) << " within " << mem_budget << endl;
+   }
+   if (heap_bytes > report.m_peak_bytes) {
+       cout << "Error: Allocated " << heap_bytes << " bytes, more than the reported " << report.m_peak_bytes << endl;
+   }
+}
+
+template <class T>
+void TestBudgetIntegralType(size_t max_val, size_t sz, size_t mem_budget, RadixStrategy expected)
+{
+   cout << "\nSorting array of " << sz << " " << typeid(T).name() << " with a budget of " << mem_budget
+        << " bytes, " << StrategyName(expected) << "\n";
+
+   auto arr = std::shared_ptr<T[]>(new T[sz]);
+   auto arr_ok = std::shared_ptr<T[]>(new T[sz]);
+   RadixBudgetReport report;
+
+   const auto create_entry = [max_val](T *elem1, T *elem2, size_t) {
+       *elem1 = *elem2 = GetRandIntegral<T>(max_val, false);
+   };
+   const auto radix_call = [&]() {
+       return CountHeap([&]() {return RadixSortWithBudget(arr.get(), sz, mem_budget, &report);});
+   };
+   const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [&]() {
+       checkReport(report, mem_budget, expected);
+       check(arr.get(), arr_ok.get(), sz);
+   };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestBudgetUserDefinedType(size_t sz, size_t mem_budget, RadixStrategy expected, size_t num_keys = 1000)
+{
+   cout << "\nSorting array of " << sz << " records by " << num_keys << " possible keys with a budget of " << mem_budget
+        << " bytes, " << StrategyName(expected) << "\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   RadixBudgetReport report;
+
+   const auto create_entry = [num_keys](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)(rand() % num_keys), (uint32_t)i};
+   };
+   const auto radix_call = [&]() {
+       return CountHeap([&]() {return RadixSortWithBudget(arr.get(), sz, StreamRecord::getKey, mem_budget, &report);});
+   };
+   const auto std_call = [arr_ok, sz](){std::stable_sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [&]() {
+       checkReport(report, mem_budget, expected);
+       check(arr.get(), arr_ok.get(), sz);
+   };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestGatherUserDefinedType(size_t sz, size_t num_threads)
+{
+   cout << "\nSorting array of " << sz << " class objects, rearranged by gather, " << num_threads << " threads\n";
+
+   auto arr = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
+   auto arr_ok = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
+
+   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t) {
+       *elem1 = *elem2 = SomeClass(rand());
+   };
+   const auto radix_call = [arr, sz, num_threads]() {
+       return RadixSortGather(arr.get(), sz, SomeClass::getKey, num_threads);
+   };
+   const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() {check(arr.get(), arr_ok.get(), sz);};
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestGatherRecords(size_t sz, size_t num_threads)
+{
+   cout << "\nSorting array of " << sz << " records, rearranged by gather, " << num_threads << " threads\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+
+   const auto create_entry = [](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)(rand() % 1000), (uint32_t)i};
+   };
+   const auto radix_call = [arr, sz, num_threads]() {
+       return RadixSortGather(arr.get(), sz, StreamRecord::getKey, num_threads);
+   };
+   const auto std_call = [arr_ok, sz](){std::stable_sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() {check(arr.get(), arr_ok.get(), sz);};
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestApplyPermutation(size_t sz, size_t num_threads)
+{
+   cout << "\nSorting array of " << sz << " class objects by applying its sorted indexes, " << num_threads << " threads\n";
+
+   auto arr = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
+   auto arr_ok = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
+   auto idxs = std::shared_ptr<uint32_t[]>(new uint32_t[sz]);
+
+   const auto create_entry = [](SomeClass *elem1, SomeClass *elem2, size_t) {
+       *elem1 = *elem2 = SomeClass(rand());
+   };
+   const auto radix_call = [arr, sz, idxs, num_threads]() {
+       return RadixSortIndexesOnly(arr.get(), sz, SomeClass::getKey, idxs.get()) |
+              RadixApplyPermutation(arr.get(), sz, idxs.get(), num_threads);
+   };
+   const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() {check(arr.get(), arr_ok.get(), sz);};
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+// checks the scenario of a partition: out against arr_ok stably sorted by digit, and the begins of the buckets.
+template <class T, class DIGIT>
+static void checkPartition(const T *out, const T *arr_ok, const size_t *bucket_begins, size_t num_buckets,
+                           size_t sz, const DIGIT &digit)
+{
+   for (size_t b = 0; b < num_buckets; ++b) {
+       for (size_t i = bucket_begins[b]; i < bucket_begins[b + 1]; ++i) {
+           if (digit(out[i]) != b) {
+               cout << "Error: Element of bucket " << digit(out[i]) << " in bucket " << b << ".\n";
+               return;
+           }
+       }
+   }
+   if (bucket_begins[num_buckets] != sz) {
+       cout << "Error: Buckets end at " << bucket_begins[num_buckets] << endl;
+       return;
+   }
+   for (size_t i = 0; i < sz; ++i) {
+       if (out[i] != arr_ok[i]) {
+           cout << "Error: Partition is not stable.\n";
+           return;
+       }
+   }
+
+   cout << "radix ok   ";
+}
+
+void TestPartitionIntegralType(size_t sz, size_t shift_bits, size_t digit_bits, size_t num_threads, bool write_combining,
+                               size_t out_offset = 0)
+{
+   cout << "\nPartitioning array of " << sz << " uint64_t by " << digit_bits << " bits above " << shift_bits
+        << ", " << num_threads << " threads" << (write_combining ? ", write combining" : "")
+        << (out_offset ? ", out at an offset\n" : "\n");
+
+   auto arr = std::shared_ptr<uint64_t[]>(new uint64_t[sz]);
+   auto arr_ok = std::shared_ptr<uint64_t[]>(new uint64_t[sz]);
+   auto out_buf = std::shared_ptr<uint64_t[]>(new uint64_t[sz + out_offset]);
+   uint64_t *out = out_buf.get() + out_offset;
+   const size_t num_buckets = size_t(1) << digit_bits;
+   auto begins = std::shared_ptr<size_t[]>(new size_t[num_buckets + 1]);
+   const auto digit = [=](uint64_t val) {return (size_t)(val >> shift_bits) & (num_buckets - 1);};
+
+   const auto create_entry = [](uint64_t *elem1, uint64_t *elem2, size_t) {
+       *elem1 = *elem2 = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+   };
+   const auto radix_call = [=]() {
+       if (RadixPartition(arr.get(), sz, shift_bits, RadixPartitionMaxBits + 1, out, begins.get()) != 2) {
+           cout << "Error: Digit of " << RadixPartitionMaxBits + 1 << " bits accepted\n";
+       }
+       const int empty_status = RadixPartition(
+           (const uint64_t*)nullptr, 0, shift_bits, digit_bits, (uint64_t*)nullptr, begins.get(), num_threads, write_combining);
+       if (empty_status || (begins[0] != 0) || (begins[num_buckets] != 0)) {
+           cout << "Error: Empty input was not partitioned into empty buckets\n";
+       }
+       return RadixPartition(arr.get(), sz, shift_bits, digit_bits, out, begins.get(), num_threads, write_combining);
+   };
+   const auto std_call = [=]() {
+       std::stable_sort(arr_ok.get(), arr_ok.get() + sz, [&](uint64_t lhs, uint64_t rhs) {return digit(lhs) < digit(rhs);});
+   };
+   const auto check_call = [=]() {checkPartition(out, arr_ok.get(), begins.get(), num_buckets, sz, digit);};
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestPartitionRecords(size_t sz, size_t digit_bits, size_t num_threads, bool write_combining)
+{
+   cout << "\nPartitioning array of " << sz << " records by " << digit_bits << " bits, "
+        << num_threads << " threads" << (write_combining ? ", write combining\n" : "\n");
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto out = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   const size_t num_buckets = size_t(1) << digit_bits;
+   auto begins = std::shared_ptr<size_t[]>(new size_t[num_buckets + 1]);
+   const auto digit = [=](const StreamRecord &rec) {return (size_t)StreamRecord::getKey(rec) & (num_buckets - 1);};
+
+   const auto create_entry = [](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)rand(), (uint32_t)i};
+   };
+   const auto radix_call = [=]() {
+       return RadixPartition(arr.get(), sz, StreamRecord::getKey, 0, digit_bits, out.get(), begins.get(),
+                             num_threads, write_combining);
+   };
+   const auto std_call = [=]() {
+       std::stable_sort(arr_ok.get(), arr_ok.get() + sz, [&](const StreamRecord &lhs, const StreamRecord &rhs) {
+           return digit(lhs) < digit(rhs);
+       });
+   };
+   const auto check_call = [=]() {checkPartition(out.get(), arr_ok.get(), begins.get(), num_buckets, sz, digit);};
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+template <class T>
+void TestCursorIntegralType(size_t max_val, size_t sz, size_t page_sz)
+{
+   cout << "\nPulling sorted pages of " << page_sz << " of array of " << sz << " " << typeid(T).name() << "\n";
+
+   auto arr = std::shared_ptr<T[]>(new T[sz]);
+   auto arr_ok = std::shared_ptr<T[]>(new T[sz]);
+   auto pulled = std::shared_ptr<T[]>(new T[sz + page_sz]);
+
+   const auto create_entry = [max_val](T *elem1, T *elem2, size_t) {
+       *elem1 = *elem2 = GetRandIntegral<T>(max_val, false);
+   };
+   const auto radix_call = [=]() {
+       RadixSortedCursor<T> cursor(arr.get(), sz);
+       size_t total = 0, num_out = 0;
+       do {
+           if (cursor.Pull(pulled.get() + total, page_sz, num_out)) return 1;
+           total += num_out;
+       } while (num_out == page_sz);
+
+       if (total != sz) {
+           cout << "Error: Pulled " << total << " elements\n";
+       }
+       return 0;
+   };
+   const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [=]() {
+       // the array itself is sorted, once all of it was pulled.
+       if (!std::equal(arr.get(), arr.get() + sz, arr_ok.get())) {
+           cout << "Error: The array was not sorted in place\n";
+           return;
+       }
+       check(pulled.get(), arr_ok.get(), sz);
+   };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestCursorRecords(size_t sz, size_t page_sz)
+{
+   cout << "\nPulling sorted pages of " << page_sz << " of array of " << sz << " records, and their indexes\n";
+
+   auto arr = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto arr_ok = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz]);
+   auto pulled = std::shared_ptr<StreamRecord[]>(new StreamRecord[sz + page_sz]);
+   auto idxs = std::shared_ptr<size_t[]>(new size_t[sz + page_sz]);
+
+   const auto create_entry = [](StreamRecord *elem1, StreamRecord *elem2, size_t i) {
+       *elem1 = *elem2 = StreamRecord{(uint32_t)rand() % 100000, (uint32_t)i};
+   };
+   const auto radix_call = [=]() {
+       RadixSortedCursor<StreamRecord, uint32_t> cursor(arr.get(), sz, StreamRecord::getKey);
+       RadixSortedCursor<StreamRecord, uint32_t> idx_cursor(arr.get(), sz, StreamRecord::getKey);
+       size_t total = 0, num_out = 0, num_idx_out = 0;
+       do {
+           if (cursor.Pull(pulled.get() + total, page_sz, num_out) ||
+               idx_cursor.PullIndexes(idxs.get() + total, page_sz, num_idx_out)) return 1;
+           total += num_out;
+       } while ((num_out == page_sz) && (num_idx_out == page_sz));
+
+       if ((total != sz) || (num_out != num_idx_out)) {
+           cout << "Error: Pulled " << total << " elements\n";
+       }
+       return 0;
+   };
+   const auto std_call = [arr_ok, sz](){std::stable_sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [=]() {
+       for (size_t i = 0; i < sz; ++i) {
+           if (arr[idxs[i]] != arr_ok[i]) {
+               cout << "Error: Pulled indexes are not sorted\n";
+               return;
+           }
+       }
+       check(pulled.get(), arr_ok.get(), sz);
+   };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+template <class T>
+void TestArrIntegralTypeSkewed(size_t sz, size_t percent_low)
+{
+   cout << "\nSorting array of " << sz << " " << typeid(T).name() << ", " << percent_low << "% of them low\n";
+
+   auto arr = std::shared_ptr<T[]>(new T[sz]);
+   auto arr_ok = std::shared_ptr<T[]>(new T[sz]);
+
+   // the low values are all in the bottom bucket of the top digit, which is then too large for the cache.
+   const auto create_entry = [percent_low](T *elem1, T *elem2, size_t) {
+       const bool low = ((size_t)(rand() % 100) < percent_low);
+       *elem1 = *elem2 = GetRandIntegral<T>(low ? 1 << 20 : numeric_limits<T>::max(), true, false);
+   };
+   const auto radix_call = [arr, sz]() {return RadixSort(arr.get(), sz);};
+   const auto std_call = [arr_ok, sz](){std::sort(arr_ok.get(), arr_ok.get() + sz);};
+   const auto check_call = [arr, arr_ok, sz]() { check(arr.get(), arr_ok.get(), sz); };
+
+   TestImpl(arr.get(), arr_ok.get(), sz, create_entry, radix_call, std_call, check_call);
+}
+
+void TestAsync(size_t sz, size_t num_batches)
+{
+   cout << "\nSorting " << num_batches << " batches of " << sz << " int and records asynchronously, and cancelling\n";
+
+   // runs each task on a thread of its own, all of them joined at the end of the test.
+   std::vector<std::thread> threads;
+   const auto executor = [&threads](std::function<void()> task) {threads.emplace_back(std::move(task));};
+
+   std::vector<std::vector<int>> batches(num_batches, std::vector<int>(sz));
+   std::vector<std::vector<StreamRecord>> records(num_batches, std::vector<StreamRecord>(sz));
+   std::vector<std::future<int>> futures;
+   for (size_t b = 0; b < num_batches; ++b) {
+       for (size_t i = 0; i < sz; ++i) {
+           batches[b][i] = GetRandIntegral<int>(INT_MAX, false);
+           records[b][i] = StreamRecord{(uint32_t)(rand() % 1000), (uint32_t)i};
+       }
+   }
+   // taken before the batches are sorted, on the threads of the executor.
+   const std::vector<StreamRecord> unsorted = records[0];
+   for (size_t b = 0; b < num_batches; ++b) {
+       futures.push_back(RadixSortAsync(executor, batches[b].data(), sz));
+       futures.push_back(RadixSortAsync(executor, records[b].data(), sz, StreamRecord::getKey));
+   }
+
+   RadixCancelToken token;
+   token.Cancel();
+   std::vector<StreamRecord> cancelled = unsorted;
+   std::future<int> cancelled_future = RadixSortAsync(executor, cancelled.data(), sz, StreamRecord::getKey, &token);
+
+   bool ok = true;
+   for (size_t b = 0; b < num_batches; ++b) {
+       if (futures[2 * b].get() || futures[2 * b + 1].get() ||
+           !std::is_sorted(batches[b].begin(), batches[b].end()) ||
+           !std::is_sorted(records[b].begin(), records[b].end(), [](const StreamRecord &lhs, const StreamRecord &rhs) {
+               return (lhs.m_key < rhs.m_key) || ((lhs.m_key == rhs.m_key) && (lhs.m_seq < rhs.m_seq));
+           })) {
+           cout << "Error: Batch " << b << " was not sorted\n";
+           ok = false;
+       }
+   }
+   if ((cancelled_future.get() != 3) || !std::equal(cancelled.begin(), cancelled.end(), unsorted.begin(),
+           [](const StreamRecord &lhs, const StreamRecord &rhs) {return !(lhs != rhs);})) {
+       cout << "Error: The cancelled sort did not report it, or changed the array\n";
+       ok = false;
+   }
+
+   for (auto &thread : threads) {
+       thread.join();
+   }
+   if (ok) {
+       cout << "radix ok\n";
+   }
+}
+
+void TestAsyncCancelPartway(size_t sz, size_t num_tries)
+{
+   cout << "\nSorting " << sz << " int64_t asynchronously, cancelling partway " << num_tries << " times\n";
+
+   std::vector<int64_t> unsorted(sz);
+   for (auto &val : unsorted) {
+       val = GetRandIntegral<int64_t>(INT64_MAX, false);
+   }
+   std::vector<int64_t> sorted_ok = unsorted;
+   std::sort(sorted_ok.begin(), sorted_ok.end());
+
+   // the sort is cancelled after a growing delay, from before it starts to after it is done. Either way, the array
+   // must still have all of its elements.
+   size_t num_cancelled = 0;
+   for (size_t t = 0; t < num_tries; ++t) {
+       std::vector<int64_t> arr = unsorted;
+       RadixCancelToken token;
+       std::future<int> future = RadixSortAsync(
+           [](std::function<void()> task) {std::thread(std::move(task)).detach();}, arr.data(), sz, &token);
+       std::this_thread::sleep_for(std::chrono::milliseconds(t * 5));
+       token.Cancel();
+
+       const int result = future.get();
+       num_cancelled += (3 == result);
+       if ((0 == result) && !std::is_sorted(arr.begin(), arr.end())) {
+           cout << "Error: The sort was not cancelled, but did not sort\n";
+           return;
+       }
+       std::sort(arr.begin(), arr.end());
+       if ((result && (3 != result)) || (arr != sorted_ok)) {
+           cout << "Error: The cancelled sort failed, or lost elements\n";
+           return;
+       }
+   }
+   cout << num_cancelled << " cancelled, radix ok\n";
+}
+
+void TestStats(size_t sz)
+{
+   cout << "\nCollecting stats of sorting arrays of " << sz << " unsigned short, uint64_t and class objects\n";
+
+   auto arr = std::shared_ptr<unsigned short[]>(new unsigned short[sz]);
+   auto wide = std::shared_ptr<uint64_t[]>(new uint64_t[sz]);
+   auto objs = std::shared_ptr<SomeClass[]>(new SomeClass[sz]);
+   for (size_t i = 0; i < sz; ++i) {
+       arr[i] = rand() % 256;
+       wide[i] = 1000000000000ULL + rand() % 10000000;
+       objs[i] = SomeClass(rand() % sz);
+   }
+   // make the range of the uint64_t values exactly 1e7
+   wide[0] = 1000000000000ULL;
+   wide[sz - 1] = 1000000000000ULL + 10000000;
+
+   RadixStats stats;
+   {
+       RadixStatsScope scope(stats);
+       if (RadixSort(arr.get(), sz) || RadixSort(wide.get(), sz) || RadixSort(objs.get(), sz, SomeClass::getKey)) {
+           cout << "Error: Could not allocate memory\n";
+           return;
+       }
+   }
+   RadixSort(arr.get(), sz);
+
+#ifndef RADIX_SORT_STATS
+   if (stats.m_rounds || stats.m_key_scan.m_calls || stats.m_scatter.m_elements || stats.m_bytes_moved ||
+       stats.m_scratch_bytes_allocated) {
+       cout << "Error: Stats collected without RADIX_SORT_STATS\n";
+       return;
+   }
+   cout << "radix ok   no stats collected without RADIX_SORT_STATS\n";
+#else
+   // the shorts and the keys (sz <= 2^8) are within a range of 2^8: a single round each.
+   // the uint64_t values are within a range of 2^24: 3 rounds of 8 bits, rather than 8 rounds.
+   if ((stats.m_rounds != 1 + 3 + 1) || (stats.m_rounds_skipped != 0)) {
+       cout << "Error: Wrong count of rounds: " << stats.m_rounds << ", skipped: " << stats.m_rounds_skipped << endl;
+       return;
+   }
+   if ((stats.m_key_scan.m_calls != 2) || (stats.m_key_extraction.m_elements != sz) ||
+       (stats.m_rearrange.m_calls != 1) || (stats.m_scatter.m_elements != 5 * sz) ||
+       (stats.m_scratch_bytes_allocated != sz * (sizeof(uint64_t) + 2 * sizeof(RadixEntry<size_t>)))) {
+       cout << "Error: Wrong phase stats\n";
+       return;
+   }
+
+   cout << "radix ok   " << stats.m_bytes_moved << " bytes moved, "
+        << stats.m_histogram.m_nanoseconds + stats.m_scatter.m_nanoseconds << " ns in rounds\n";
+#endif
+}
+
 int main()
 {
    const unsigned int sz = 100000;
@@ -557,6 +1320,7 @@ int main()
    TestArrIntegralType<int>(INT_MAX, sz, false);
    TestArrIntegralType<int>(INT_MAX, sz, false);
    TestArrIntegralType<short>(SHRT_MAX, sz, false);
+   TestArrIntegralType<signed char>(SCHAR_MAX, sz, false);
 
    TestListUserDefinedType(sz);
    TestListUserDefinedTypeAllocateHere(sz);
@@ -571,6 +1335,70 @@ int main()
    TestVectorIntegralType(sz);
    TestVectorUserDefinedType(sz);
 
+   for (Presorted presorted : {Presorted::sorted, Presorted::reversed, Presorted::reversed_with_dups, Presorted::few_runs}) {
+       TestArrIntegralTypePresorted<int>(sz, presorted);
+       TestArrIntegralTypePresorted<int64_t>(sz, presorted);
+       TestArrUserDefinedTypePresorted(sz, presorted);
+   }
+
+   TestArrUserDefinedTypeIndexesAndRanks32(sz, 100);
+   TestArrUserDefinedTypeIndexesAndRanks32(sz, UINT32_MAX);
+
+   TestGroupBy(sz, 100);
+   TestGroupBy(sz, sz * 10);
+   TestUnique<int>(1000, sz);
+   TestUnique<int64_t>(INT64_MAX, sz);
+   TestUnique<unsigned short>(USHRT_MAX, sz);
+
+   TestSegmentsIntegralType<int>(INT_MAX, sz, 500, 1);
+   TestSegmentsIntegralType<int64_t>(INT64_MAX, sz * 10, 500, 4);
+   TestSegmentsIntegralType<unsigned char>(UCHAR_MAX, sz, 20, 4);
+   TestSegmentsUserDefinedType(sz, 500, 1);
+   TestSegmentsUserDefinedType(sz * 10, 500, 4);
+
+   TestGatherUserDefinedType(sz, 4);
+   TestGatherRecords(sz, 4);
+   TestGatherRecords(sz, 1);
+   TestApplyPermutation(sz, 4);
+
+   TestPartitionIntegralType(sz, 0, 8, 1, false);
+   TestPartitionIntegralType(sz, 20, 12, 4, true);
+   TestPartitionIntegralType(1000, 0, 6, 1, true, 3);
+   TestPartitionIntegralType(sz, 60, 4, 4, false);
+   TestPartitionRecords(sz, 10, 4, false);
+   TestPartitionRecords(sz, 16, 1, true);
+
+   TestCursorIntegralType<int>(INT_MAX, sz, 50);
+   TestCursorIntegralType<int64_t>(INT64_MAX, sz, 1000);
+   TestCursorIntegralType<unsigned char>(UCHAR_MAX, sz, 3000);
+   TestCursorRecords(sz, 50);
+
+   TestArrIntegralType<int64_t>(INT64_MAX, sz * 10, false);
+   TestArrIntegralTypeSkewed<int64_t>(sz * 10, 90);
+   TestArrIntegralTypeSkewed<uint32_t>(sz * 10, 50);
+   TestArrUserDefinedTypeIndexesAndRanks32(sz * 10, sz * 10);
+
+   TestAsync(sz, 4);
+   TestAsyncCancelPartway(sz * 40, 10);
+
+   TestBudgetIntegralType<int>(INT_MAX, sz, sz * sizeof(int), RadixStrategy::lsd);
+   TestBudgetIntegralType<int>(INT_MAX, sz, sz, RadixStrategy::in_place_msd);
+   TestBudgetIntegralType<int64_t>(INT64_MAX, sz, 0, RadixStrategy::in_place_msd);
+   TestBudgetIntegralType<unsigned short>(USHRT_MAX, sz, 0, RadixStrategy::in_place_msd);
+   TestBudgetUserDefinedType(sz, sz * 2 * sizeof(RadixEntry<size_t>), RadixStrategy::lsd);
+   TestBudgetUserDefinedType(sz, sz * 2 * sizeof(RadixEntry<size_t>) / 10, RadixStrategy::chunked_merge);
+   TestBudgetUserDefinedType(sz, 1000, RadixStrategy::in_place_merge);
+   // a range of 2^16 keys, that the regular sort counts in a single round, with its counters on the heap.
+   TestBudgetIntegralType<uint16_t>(USHRT_MAX, 1 << 16, (1 << 16) * sizeof(uint16_t), RadixStrategy::lsd);
+   TestBudgetUserDefinedType(1 << 16, (1 << 16) * 2 * sizeof(RadixEntry<size_t>), RadixStrategy::lsd, 1 << 16);
+
+   TestConstexprSort();
+   TestStats(200);
+
+   TestStreamIntegralType<int>(INT_MAX, sz, 3000, sz * sizeof(int));
+   TestStreamIntegralType<int64_t>(INT64_MAX, sz, 7000, 20000);
+   TestStreamUserDefinedType(sz, 5000, 40000);
+
 //    TestListUserDefinedType(1);
 //    TestListUserDefinedType(0);
 //    TestArrUserDefinedType(1);